@@ -17,6 +17,7 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE (200809L)
 
 #include <assert.h>
@@ -25,6 +26,7 @@
 #include <fcntl.h>
 #include <linux/nbd.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,6 +34,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -89,6 +92,28 @@ static int write_all(int fd, char* buf, size_t count)
   return 0;
 }
 
+/* Writes all buffers with as few syscalls as possible. Moves iov forward, so it's modified. */
+static int writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+  ssize_t bytes_written;
+
+  while (iovcnt > 0) {
+    bytes_written = writev(fd, iov, iovcnt);
+    assert(bytes_written > 0);
+    while (iovcnt > 0 && (size_t)bytes_written >= iov->iov_len) {
+      bytes_written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char*)iov->iov_base + bytes_written;
+      iov->iov_len -= bytes_written;
+    }
+  }
+
+  return 0;
+}
+
 /* Signal handler to gracefully disconnect from nbd kernel driver. */
 static int nbd_dev_to_disconnect = -1;
 static void disconnect_nbd(int signal) {
@@ -113,6 +138,284 @@ static int set_sigaction(int sig, const struct sigaction * act) {
   return r;
 }
 
+/* Makes sure that chunk buffer has at least len bytes. Buffer is only grown,
+ * so after the first few requests there are no allocations at all. It's aligned
+ * to page, so it can be passed to O_DIRECT reads as is. Returns NULL on failure. */
+static void *ensure_chunk(void **chunk, u_int32_t *capacity, u_int32_t len) {
+  void *bigger;
+  if (len <= *capacity) {
+    return *chunk;
+  }
+  if (posix_memalign(&bigger, 4096, len) != 0) {
+    return NULL;
+  }
+  free(*chunk);
+  *chunk = bigger;
+  *capacity = len;
+  return bigger;
+}
+
+/* State of one nbd socket. With threads reads are queued for workers
+ * and replies are written by whichever thread has finished the request. */
+struct buse_job {
+  struct buse_job *next;
+  char handle[8];
+  u_int64_t from;
+  u_int32_t len;
+};
+
+struct buse_server {
+  int sk;
+  const struct buse_operations *aop;
+  void *userdata;
+
+  /* Replies from different threads can't interleave on the socket. */
+  pthread_mutex_t write_lock;
+
+  /* Guards everything below. */
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready;
+  pthread_cond_t idle;
+  struct buse_job *head;
+  struct buse_job *tail;
+  u_int32_t in_flight;
+  int stopping;
+};
+
+/* Buffers of one serving thread. */
+struct buse_buffers {
+  void *chunk;
+  u_int32_t chunk_capacity;
+  /* Spliced data waits here until the whole read is ready, -1 if not created yet. */
+  int pipe[2];
+  u_int32_t pipe_capacity;
+};
+
+#define BUSE_BUFFERS_INIT { NULL, 0, { -1, -1 }, 0 }
+
+/* Pipe is made this big, if system allows it. */
+#define BUSE_SPLICE_PIPE_SIZE (1024 * 1024)
+#define BUSE_MAX_EXTENTS 256
+
+static void close_pipe(struct buse_buffers *bufs) {
+  if (bufs->pipe[0] != -1) {
+    close(bufs->pipe[0]);
+    close(bufs->pipe[1]);
+    bufs->pipe[0] = bufs->pipe[1] = -1;
+  }
+}
+
+static void free_buffers(struct buse_buffers *bufs) {
+  free(bufs->chunk);
+  close_pipe(bufs);
+}
+
+static void send_reply(struct buse_server *srv, struct nbd_reply *reply, void *data, u_int32_t len) {
+  struct iovec iov[2] = {
+    { .iov_base = reply, .iov_len = sizeof(struct nbd_reply) },
+    { .iov_base = data, .iov_len = len },
+  };
+
+  pthread_mutex_lock(&srv->write_lock);
+  writev_all(srv->sk, iov, len > 0 ? 2 : 1);
+  pthread_mutex_unlock(&srv->write_lock);
+}
+
+/* Sends data of the read with splice, from files to pipe and from pipe to socket.
+ * Whole read is put into the pipe before reply is sent, so if any file fails
+ * nothing is sent yet and the read can be served with read operation instead.
+ * Returns 1 if reply is sent. */
+static int splice_read(struct buse_server *srv, struct nbd_reply *reply,
+                       struct buse_buffers *bufs, u_int32_t len, u_int64_t from) {
+  struct buse_extent extents[BUSE_MAX_EXTENTS];
+  int count, i;
+  ssize_t spliced;
+
+  if (bufs->pipe[0] == -1) {
+    if (pipe(bufs->pipe) == -1) {
+      return 0;
+    }
+    fcntl(bufs->pipe[1], F_SETPIPE_SZ, BUSE_SPLICE_PIPE_SIZE);
+    bufs->pipe_capacity = fcntl(bufs->pipe[1], F_GETPIPE_SZ);
+  }
+
+  /* Pipe holds pages, not bytes, extents which don't start at page boundary take
+   * more space than their length. Half of the pipe leaves enough room for them. */
+  if (len > bufs->pipe_capacity / 2) {
+    return 0;
+  }
+
+  count = srv->aop->map(extents, BUSE_MAX_EXTENTS, len, from, srv->userdata);
+  if (count <= 0) {
+    return 0;
+  }
+
+  for (i = 0; i < count; i++) {
+    loff_t offset = extents[i].offset;
+    u_int32_t left = extents[i].len;
+
+    while (left > 0) {
+      /* Nobody drains the pipe meanwhile, so full pipe must be an error, not a deadlock */
+      spliced = splice(extents[i].fd, &offset, bufs->pipe[1], NULL, left, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (spliced == -1 && errno == EINTR) {
+        continue;
+      }
+      if (spliced <= 0) {
+        /* Throw away what's already in the pipe */
+        close_pipe(bufs);
+        return 0;
+      }
+      left -= spliced;
+    }
+  }
+
+  pthread_mutex_lock(&srv->write_lock);
+  write_all(srv->sk, (char*)reply, sizeof(struct nbd_reply));
+  while (len > 0) {
+    spliced = splice(bufs->pipe[0], NULL, srv->sk, NULL, len, SPLICE_F_MOVE);
+    if (spliced == -1 && errno == EINTR) {
+      continue;
+    }
+    assert(spliced > 0);
+    len -= spliced;
+  }
+  pthread_mutex_unlock(&srv->write_lock);
+
+  return 1;
+}
+
+static void serve_read(struct buse_server *srv, struct nbd_reply *reply,
+                       struct buse_buffers *bufs, u_int32_t len, u_int64_t from) {
+  if (BUSE_DEBUG) fprintf(stderr, "Request for read of size %d\n", len);
+  if (srv->aop->map && splice_read(srv, reply, bufs, len, from)) {
+    return;
+  }
+  if (ensure_chunk(&bufs->chunk, &bufs->chunk_capacity, len) == NULL) {
+    err(EXIT_FAILURE, "allocating buffer for read request of size %u", len);
+  }
+  if (srv->aop->read) {
+    reply->error = srv->aop->read(bufs->chunk, len, from, srv->userdata);
+  } else {
+    /* If user not specified read operation, return EPERM error */
+    reply->error = htonl(EPERM);
+  }
+  send_reply(srv, reply, bufs->chunk, len);
+}
+
+static void *read_worker(void *arg) {
+  struct buse_server *srv = arg;
+  struct buse_job *job;
+  struct nbd_reply reply;
+  struct buse_buffers bufs = BUSE_BUFFERS_INIT;
+
+  reply.magic = htonl(NBD_REPLY_MAGIC);
+
+  for (;;) {
+    pthread_mutex_lock(&srv->lock);
+    while (srv->head == NULL && !srv->stopping) {
+      pthread_cond_wait(&srv->job_ready, &srv->lock);
+    }
+    job = srv->head;
+    if (job != NULL) {
+      srv->head = job->next;
+      if (srv->head == NULL) {
+        srv->tail = NULL;
+      }
+    }
+    pthread_mutex_unlock(&srv->lock);
+
+    if (job == NULL) {
+      break;
+    }
+
+    memcpy(reply.handle, job->handle, sizeof(reply.handle));
+    reply.error = htonl(0);
+    serve_read(srv, &reply, &bufs, job->len, job->from);
+    free(job);
+
+    pthread_mutex_lock(&srv->lock);
+    if (--srv->in_flight == 0) {
+      pthread_cond_broadcast(&srv->idle);
+    }
+    pthread_mutex_unlock(&srv->lock);
+  }
+
+  free_buffers(&bufs);
+  return NULL;
+}
+
+static void queue_read(struct buse_server *srv, struct nbd_request *request) {
+  struct buse_job *job = malloc(sizeof(struct buse_job));
+  if (job == NULL) {
+    err(EXIT_FAILURE, "allocating read request");
+  }
+  memcpy(job->handle, request->handle, sizeof(job->handle));
+  job->from = ntohll(request->from);
+  job->len = ntohl(request->len);
+  job->next = NULL;
+
+  pthread_mutex_lock(&srv->lock);
+  if (srv->tail != NULL) {
+    srv->tail->next = job;
+  } else {
+    srv->head = job;
+  }
+  srv->tail = job;
+  srv->in_flight++;
+  pthread_cond_signal(&srv->job_ready);
+  pthread_mutex_unlock(&srv->lock);
+}
+
+/* Waits until every queued read has been replied. */
+static void wait_for_reads(struct buse_server *srv) {
+  pthread_mutex_lock(&srv->lock);
+  while (srv->in_flight > 0) {
+    pthread_cond_wait(&srv->idle, &srv->lock);
+  }
+  pthread_mutex_unlock(&srv->lock);
+}
+
+/* Threads are started with termination signals blocked, so they're delivered
+ * to the main thread which has installed the handler. */
+static void block_termination_signals(sigset_t *old) {
+  sigset_t blocked;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &blocked, old);
+}
+
+/* Returns number of started threads. */
+static u_int32_t start_workers(struct buse_server *srv, pthread_t *workers, u_int32_t count) {
+  sigset_t old;
+  u_int32_t started;
+
+  block_termination_signals(&old);
+
+  for (started = 0; started < count; started++) {
+    if (pthread_create(&workers[started], NULL, read_worker, srv) != 0) {
+      warnx("failed to start read worker %u", started);
+      break;
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return started;
+}
+
+static void stop_workers(struct buse_server *srv, pthread_t *workers, u_int32_t count) {
+  u_int32_t i;
+
+  pthread_mutex_lock(&srv->lock);
+  srv->stopping = 1;
+  pthread_cond_broadcast(&srv->job_ready);
+  pthread_mutex_unlock(&srv->lock);
+
+  for (i = 0; i < count; i++) {
+    pthread_join(workers[i], NULL);
+  }
+}
+
 /* Serve userland side of nbd socket. If everything worked ok, return 0. */
 static int serve_nbd(int sk, const struct buse_operations * aop, void * userdata) {
   u_int64_t from;
@@ -120,7 +423,26 @@ static int serve_nbd(int sk, const struct buse_operations * aop, void * userdata
   ssize_t bytes_read;
   struct nbd_request request;
   struct nbd_reply reply;
-  void *chunk;
+  struct buse_buffers bufs = BUSE_BUFFERS_INIT;
+  struct buse_server srv = {
+    .sk = sk,
+    .aop = aop,
+    .userdata = userdata,
+    .write_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_ready = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+  };
+  pthread_t *workers = NULL;
+  u_int32_t worker_count = 0;
+
+  if (aop->threads > 1) {
+    workers = calloc(aop->threads, sizeof(pthread_t));
+    if (workers == NULL) {
+      err(EXIT_FAILURE, "allocating %u read workers", aop->threads);
+    }
+    worker_count = start_workers(&srv, workers, aop->threads);
+  }
 
   reply.magic = htonl(NBD_REPLY_MAGIC);
   reply.error = htonl(0);
@@ -141,39 +463,36 @@ static int serve_nbd(int sk, const struct buse_operations * aop, void * userdata
        * and writes.
        */
     case NBD_CMD_READ:
-      if (BUSE_DEBUG) fprintf(stderr, "Request for read of size %d\n", len);
-      /* Fill with zero in case actual read is not implemented */
-      chunk = malloc(len);
-      if (aop->read) {
-        reply.error = aop->read(chunk, len, from, userdata);
+      if (worker_count > 0) {
+        queue_read(&srv, &request);
       } else {
-        /* If user not specified read operation, return EPERM error */
-        reply.error = htonl(EPERM);
+        serve_read(&srv, &reply, &bufs, len, from);
       }
-      write_all(sk, (char*)&reply, sizeof(struct nbd_reply));
-      write_all(sk, (char*)chunk, len);
-
-      free(chunk);
       break;
     case NBD_CMD_WRITE:
       if (BUSE_DEBUG) fprintf(stderr, "Request for write of size %d\n", len);
-      chunk = malloc(len);
-      read_all(sk, chunk, len);
+      if (ensure_chunk(&bufs.chunk, &bufs.chunk_capacity, len) == NULL) {
+        err(EXIT_FAILURE, "allocating buffer for write request of size %u", len);
+      }
+      read_all(sk, bufs.chunk, len);
       if (aop->write) {
-        reply.error = aop->write(chunk, len, from, userdata);
+        reply.error = aop->write(bufs.chunk, len, from, userdata);
       } else {
         /* If user not specified write operation, return EPERM error */
         reply.error = htonl(EPERM);
       }
-      free(chunk);
-      write_all(sk, (char*)&reply, sizeof(struct nbd_reply));
+      send_reply(&srv, &reply, NULL, 0);
       break;
     case NBD_CMD_DISC:
       if (BUSE_DEBUG) fprintf(stderr, "Got NBD_CMD_DISC\n");
-      /* Handle a disconnect request. */
+      /* Handle a disconnect request, after all reads are replied. */
+      wait_for_reads(&srv);
       if (aop->disc) {
         aop->disc(userdata);
       }
+      stop_workers(&srv, workers, worker_count);
+      free(workers);
+      free_buffers(&bufs);
       return EXIT_SUCCESS;
 #ifdef NBD_FLAG_SEND_FLUSH
     case NBD_CMD_FLUSH:
@@ -181,7 +500,7 @@ static int serve_nbd(int sk, const struct buse_operations * aop, void * userdata
       if (aop->flush) {
         reply.error = aop->flush(userdata);
       }
-      write_all(sk, (char*)&reply, sizeof(struct nbd_reply));
+      send_reply(&srv, &reply, NULL, 0);
       break;
 #endif
 #ifdef NBD_FLAG_SEND_TRIM
@@ -190,13 +509,17 @@ static int serve_nbd(int sk, const struct buse_operations * aop, void * userdata
       if (aop->trim) {
         reply.error = aop->trim(from, len, userdata);
       }
-      write_all(sk, (char*)&reply, sizeof(struct nbd_reply));
+      send_reply(&srv, &reply, NULL, 0);
       break;
 #endif
     default:
       assert(0);
     }
   }
+  wait_for_reads(&srv);
+  stop_workers(&srv, workers, worker_count);
+  free(workers);
+  free_buffers(&bufs);
   if (bytes_read == -1) {
     warn("error reading userside of nbd socket");
     return EXIT_FAILURE;
@@ -204,13 +527,39 @@ static int serve_nbd(int sk, const struct buse_operations * aop, void * userdata
   return EXIT_SUCCESS;
 }
 
+struct buse_connection {
+  pthread_t thread;
+  int sk;
+  const struct buse_operations *aop;
+  void *userdata;
+  int status;
+};
+
+static void *serve_connection(void *arg) {
+  struct buse_connection *conn = arg;
+  conn->status = serve_nbd(conn->sk, conn->aop, conn->userdata);
+  return NULL;
+}
+
 int buse_main(const char* dev_file, const struct buse_operations *aop, void *userdata)
 {
   int sp[2];
-  int nbd, sk, err, flags;
-
-  err = socketpair(AF_UNIX, SOCK_STREAM, 0, sp);
-  assert(!err);
+  int nbd, err, flags;
+  u_int32_t i;
+  u_int32_t connection_count = aop->connections > 1 ? aop->connections : 1;
+  struct buse_connection *connections = calloc(connection_count, sizeof(struct buse_connection));
+  int *peers = calloc(connection_count, sizeof(int));
+  assert(connections != NULL && peers != NULL);
+
+  /* Server side of every socket is in connections, nbd side in peers. */
+  for (i = 0; i < connection_count; i++) {
+    err = socketpair(AF_UNIX, SOCK_STREAM, 0, sp);
+    assert(!err);
+    connections[i].sk = sp[0];
+    connections[i].aop = aop;
+    connections[i].userdata = userdata;
+    peers[i] = sp[1];
+  }
 
   nbd = open(dev_file, O_RDWR);
   if (nbd == -1) {
@@ -250,34 +599,39 @@ int buse_main(const char* dev_file, const struct buse_operations *aop, void *use
       exit(EXIT_FAILURE);
     }
 
-    /* The child needs to continue setting things up. */
-    close(sp[0]);
-    sk = sp[1];
-
-    if(ioctl(nbd, NBD_SET_SOCK, sk) == -1){
-      fprintf(stderr, "ioctl(nbd, NBD_SET_SOCK, sk) failed.[%s]\n", strerror(errno));
-      exit(EXIT_FAILURE);
+    /* The child needs to continue setting things up. Every socket
+     * given with NBD_SET_SOCK becomes another connection of the device. */
+    for (i = 0; i < connection_count; i++) {
+      close(connections[i].sk);
+      if(ioctl(nbd, NBD_SET_SOCK, peers[i]) == -1){
+        fprintf(stderr, "ioctl(nbd, NBD_SET_SOCK, sk) failed.[%s]\n", strerror(errno));
+        exit(EXIT_FAILURE);
+      }
     }
-    else{
 #if defined NBD_SET_FLAGS
-      flags = 0;
+    flags = 0;
+#if defined NBD_FLAG_CAN_MULTI_CONN
+    /* Kernel refuses to start device with many sockets without it */
+    if (connection_count > 1) {
+      flags |= NBD_FLAG_CAN_MULTI_CONN;
+    }
+#endif
 #if defined NBD_FLAG_SEND_TRIM
-      flags |= NBD_FLAG_SEND_TRIM;
+    flags |= NBD_FLAG_SEND_TRIM;
 #endif
 #if defined NBD_FLAG_SEND_FLUSH
-      flags |= NBD_FLAG_SEND_FLUSH;
+    flags |= NBD_FLAG_SEND_FLUSH;
 #endif
-      if (flags != 0 && ioctl(nbd, NBD_SET_FLAGS, flags) == -1){
-        fprintf(stderr, "ioctl(nbd, NBD_SET_FLAGS, %d) failed.[%s]\n", flags, strerror(errno));
-        exit(EXIT_FAILURE);
-      }
+    if (flags != 0 && ioctl(nbd, NBD_SET_FLAGS, flags) == -1){
+      fprintf(stderr, "ioctl(nbd, NBD_SET_FLAGS, %d) failed.[%s]\n", flags, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
 #endif
-      err = ioctl(nbd, NBD_DO_IT);
-      if (BUSE_DEBUG) fprintf(stderr, "nbd device terminated with code %d\n", err);
-      if (err == -1) {
-        warn("NBD_DO_IT terminated with error");
-        exit(EXIT_FAILURE);
-      }
+    err = ioctl(nbd, NBD_DO_IT);
+    if (BUSE_DEBUG) fprintf(stderr, "nbd device terminated with code %d\n", err);
+    if (err == -1) {
+      warn("NBD_DO_IT terminated with error");
+      exit(EXIT_FAILURE);
     }
 
     if (
@@ -313,12 +667,34 @@ int buse_main(const char* dev_file, const struct buse_operations *aop, void *use
     return EXIT_FAILURE;
   }
 
-  close(sp[1]);
+  for (i = 0; i < connection_count; i++) {
+    close(peers[i]);
+  }
+  free(peers);
+
+  /* serve NBD sockets, the first one in this thread */
+  sigset_t old_mask;
+  block_termination_signals(&old_mask);
+  for (i = 1; i < connection_count; i++) {
+    if (pthread_create(&connections[i].thread, NULL, serve_connection, &connections[i]) != 0) {
+      warnx("failed to start thread for nbd connection %u", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
 
-  /* serve NBD socket */
   int status;
-  status = serve_nbd(sp[0], aop, userdata);
-  if (close(sp[0]) != 0) warn("problem closing server side nbd socket");
+  serve_connection(&connections[0]);
+  for (i = 1; i < connection_count; i++) {
+    pthread_join(connections[i].thread, NULL);
+  }
+
+  status = EXIT_SUCCESS;
+  for (i = 0; i < connection_count; i++) {
+    if (close(connections[i].sk) != 0) warn("problem closing server side nbd socket");
+    if (status == EXIT_SUCCESS) status = connections[i].status;
+  }
+  free(connections);
   if (status != 0) return status;
 
   /* wait for subprocess */
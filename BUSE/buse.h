@@ -7,6 +7,13 @@ extern "C" {
 
 #include <sys/types.h>
 
+  // range of file descriptor, which holds part of data of a read
+  struct buse_extent {
+    int fd;
+    u_int64_t offset;
+    u_int32_t len;
+  };
+
   struct buse_operations {
     int (*read)(void *buf, u_int32_t len, u_int64_t offset, void *userdata);
     int (*write)(const void *buf, u_int32_t len, u_int64_t offset, void *userdata);
@@ -14,10 +21,26 @@ extern "C" {
     int (*flush)(void *userdata);
     int (*trim)(u_int64_t from, u_int32_t len, void *userdata);
 
+    // optional, fills extents with ranges of file descriptors holding data of the read,
+    // in order. Data is then spliced from them straight to nbd socket, without copying
+    // it thru userspace. Returns number of extents or -1 if read can't be served this way
+    // (needs more than max_extents extents or some data is not in any file), then read is used.
+    int (*map)(struct buse_extent *extents, int max_extents, u_int32_t len, u_int64_t offset, void *userdata);
+
     // either set size, OR set both blksize and size_blocks
     u_int64_t size;
     u_int32_t blksize;
     u_int64_t size_blocks;
+
+    // number of threads serving read requests, replies are sent as soon as
+    // each read completes, so they can come back out of order. 0 or 1 means
+    // requests are served one after another, so read doesn't have to be thread safe.
+    u_int32_t threads;
+
+    // number of sockets connecting nbd device with BUSE, each one is served by
+    // its own thread (and its own read threads), kernel spreads requests among them.
+    // 0 or 1 means single connection. disc is called once for every connection.
+    u_int32_t connections;
   };
 
   int buse_main(const char* dev_file, const struct buse_operations *bop, void *userdata);
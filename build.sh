@@ -4,5 +4,11 @@ if [ ! -f BUSE/libbuse.a ]; then
     cd ..
 fi
 
-g++ hewlett-read.cpp src/drive_reader.cpp src/smart_array*.cpp -o hewlett-read -LBUSE -lbuse -Iinclude -O3 -std=c++23
-g++ packard-tell.cpp src/drive_reader.cpp src/metadata_parser.cpp -o packard-tell -Iinclude -O3 -std=c++23
\ No newline at end of file
+g++ hewlett-read.cpp src/array_options.cpp src/caching_drive_reader.cpp src/readahead.cpp src/drive_reader.cpp src/ddrescue_image_reader.cpp src/aligned_buffer_pool.cpp src/async_drive_reader.cpp src/io_uring_queue.cpp src/io_uring_drive_reader.cpp src/ublk_device.cpp src/thread_pool.cpp src/thread_pool_drive_reader.cpp src/xor_kernel.cpp src/scratch_arena.cpp src/read_planner.cpp src/stripe_geometry.cpp src/galois_field.cpp src/bad_row_list.cpp src/bad_sector_map.cpp src/latency_tracker.cpp src/smart_array*.cpp -o hewlett-read -LBUSE -lbuse -Iinclude -O3 -std=c++23 -pthread
+g++ packard-tell.cpp src/drive_reader.cpp src/aligned_buffer_pool.cpp src/metadata_parser.cpp -o packard-tell -Iinclude -O3 -std=c++23
+g++ xor-bench.cpp src/xor_kernel.cpp -o xor-bench -Iinclude -O3 -std=c++23
+g++ gf-bench.cpp src/galois_field.cpp -o gf-bench -Iinclude -O3 -std=c++23
+g++ rs-check.cpp src/readahead.cpp src/drive_reader.cpp src/ddrescue_image_reader.cpp src/aligned_buffer_pool.cpp src/async_drive_reader.cpp src/thread_pool.cpp src/thread_pool_drive_reader.cpp src/xor_kernel.cpp src/scratch_arena.cpp src/read_planner.cpp src/stripe_geometry.cpp src/galois_field.cpp src/bad_row_list.cpp src/bad_sector_map.cpp src/latency_tracker.cpp src/smart_array_reader_base.cpp src/smart_array_raid_6_reader.cpp -o rs-check -Iinclude -O3 -std=c++23 -pthread
+g++ hewlett-serve.cpp src/array_options.cpp src/caching_drive_reader.cpp src/readahead.cpp src/nbd_server.cpp src/drive_reader.cpp src/ddrescue_image_reader.cpp src/aligned_buffer_pool.cpp src/async_drive_reader.cpp src/io_uring_queue.cpp src/io_uring_drive_reader.cpp src/thread_pool.cpp src/thread_pool_drive_reader.cpp src/xor_kernel.cpp src/scratch_arena.cpp src/read_planner.cpp src/stripe_geometry.cpp src/galois_field.cpp src/bad_row_list.cpp src/bad_sector_map.cpp src/latency_tracker.cpp src/smart_array*.cpp -o hewlett-serve -Iinclude -O3 -std=c++23 -pthread
+g++ hewlett-extract.cpp src/array_options.cpp src/caching_drive_reader.cpp src/readahead.cpp src/image_extractor.cpp src/progress_monitor.cpp src/rebuilt_drive_reader.cpp src/metadata_parser.cpp src/drive_reader.cpp src/ddrescue_image_reader.cpp src/aligned_buffer_pool.cpp src/async_drive_reader.cpp src/io_uring_queue.cpp src/io_uring_drive_reader.cpp src/thread_pool.cpp src/thread_pool_drive_reader.cpp src/xor_kernel.cpp src/scratch_arena.cpp src/read_planner.cpp src/stripe_geometry.cpp src/galois_field.cpp src/bad_row_list.cpp src/bad_sector_map.cpp src/latency_tracker.cpp src/smart_array*.cpp -o hewlett-extract -Iinclude -O3 -std=c++23 -pthread
+g++ hewlett-verify.cpp src/array_options.cpp src/caching_drive_reader.cpp src/readahead.cpp src/parity_scrubber.cpp src/progress_monitor.cpp src/drive_reader.cpp src/ddrescue_image_reader.cpp src/aligned_buffer_pool.cpp src/async_drive_reader.cpp src/io_uring_queue.cpp src/io_uring_drive_reader.cpp src/thread_pool.cpp src/thread_pool_drive_reader.cpp src/xor_kernel.cpp src/scratch_arena.cpp src/read_planner.cpp src/stripe_geometry.cpp src/galois_field.cpp src/bad_row_list.cpp src/bad_sector_map.cpp src/latency_tracker.cpp src/smart_array*.cpp -o hewlett-verify -Iinclude -O3 -std=c++23 -pthread
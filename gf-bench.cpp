@@ -0,0 +1,72 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include "galois_field.hpp"
+#include "types.hpp"
+
+using namespace sg;
+
+// Microbenchmark of Galois field multiplication variants used by RAID 6 Q recovery.
+// Usage: gf-bench [region size in KiB, default 256] [coefficient, default 186]
+
+static const double SECONDS_PER_VARIANT = 0.5;
+
+int main(int argc, char** argv)
+{
+    size_t len = (argc > 1 ? std::stoul(argv[1]) : 256) * 1024;
+    unsigned long coefficient = argc > 2 ? std::stoul(argv[2]) : 186;
+
+    if (len == 0 || coefficient > 255)
+    {
+        std::cerr << "Usage: " << argv[0] << " [region size in KiB] [coefficient 0-255]" << std::endl;
+        return -1;
+    }
+
+    std::mt19937_64 random(1);
+    std::vector<u8> src(len);
+    for (auto& byte : src)
+    {
+        byte = random();
+    }
+
+    std::vector<u8> expected(len, 0);
+    std::vector<u8> out(len);
+    auto kernels = gfKernels();
+    kernels.front().function(expected.data(), src.data(), coefficient, len, true);
+
+    std::cout << "out ^= " << coefficient << " * src over " << len / 1024 << " KiB region, "
+              << "GB/s counts bytes of src." << std::endl;
+
+    for (auto& kernel : kernels)
+    {
+        // Correctness first, every variant has to match the scalar one
+        std::fill(out.begin(), out.end(), 0);
+        kernel.function(out.data(), src.data(), coefficient, len, true);
+        bool correct = memcmp(out.data(), expected.data(), len) == 0;
+
+        u64 passes = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds;
+        do
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                kernel.function(out.data(), src.data(), coefficient, len, true);
+            }
+            passes += 16;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < SECONDS_PER_VARIANT);
+
+        double gigabytes = static_cast<double>(passes) * len / 1e9;
+        std::cout << std::left << std::setw(8) << kernel.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(8) << gigabytes / seconds << " GB/s"
+                  << (correct ? "" : "  WRONG RESULT")
+                  << (strcmp(kernel.name, gfKernelName()) == 0 ? "  (used)" : "") << std::endl;
+    }
+
+    return 0;
+}
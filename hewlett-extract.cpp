@@ -0,0 +1,265 @@
+#include <argp.h>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "array_options.hpp"
+#include "image_extractor.hpp"
+#include "rebuilt_drive_reader.hpp"
+
+using namespace sg;
+
+struct ProgramOptions
+{
+    ArrayOptions array;
+    std::string output;
+    u16 threads;
+    u32 chunkSize;
+    bool sparse;
+    std::string checkpoint;
+    bool resume;
+    bool rebuild;
+    /// @brief Position of rebuilt drive counting from 1, 0 means the missing one
+    u16 rebuildDrive;
+    /// @brief Allows rebuild which covers only part of the member drive
+    bool partialRebuild;
+    /// @brief Copy controller metadata of rebuilt drive from a healthy member
+    bool cloneMetadata;
+};
+
+// Argument parsing
+
+// Keys for options that have only long version
+enum LongOnlyOption
+{
+    OPT_THREADS = 1100,
+    OPT_CHUNK_SIZE,
+    OPT_NO_SPARSE,
+    OPT_CHECKPOINT,
+    OPT_RESUME,
+    OPT_REBUILD,
+    OPT_PARTIAL_REBUILD,
+    OPT_CLONE_METADATA
+};
+
+static argp_option options[] = {
+    { "output", 'o', "PATH", 0, "Image file or block device to copy the array to, required!", 0 },
+    { "threads", OPT_THREADS, "N", 0, "Number of chunks read at once. Default: 4", 0 },
+    { "chunk-size", OPT_CHUNK_SIZE, "MiB", 0, "Size of one read and write. Default: 8", 0 },
+    { "no-sparse", OPT_NO_SPARSE, 0, 0, "Write zero stripes to image file too. By default they are left as holes, so image takes only as much space as data on the array. Block devices are always written whole.", 0 },
+    { "checkpoint", OPT_CHECKPOINT, "FILE", 0, "Save progress to FILE every 10 seconds and when interrupted with Ctrl+C, so copy can be continued with --resume. It's removed when copy is done.", 0 },
+    { "resume", OPT_RESUME, 0, 0, "Continue copy from --checkpoint file.", 0 },
+    { "rebuild", OPT_REBUILD, "N", OPTION_ARG_OPTIONAL, "Instead of logical drive write raw content of N-th drive (counting from 1, missing one if N isn't given) of RAID 5 or 6 to a replacement drive, with parity stripes and controller metadata.", 0 },
+    { "partial-rebuild", OPT_PARTIAL_REBUILD, 0, 0, "Allow --rebuild of RAID 6, which regenerates only the logical drive given by --offset and --size and writes zeros over the rest of the member, destroying other logical drives on it.", 0 },
+    { "clone-metadata", OPT_CLONE_METADATA, 0, 0, "With --rebuild copy controller metadata from a healthy member with drive number changed, instead of leaving it empty. Experimental, only drive number is changed, so controller may reject the drive. With empty metadata controller sees a new drive and rebuilds it itself.", 0 },
+    {0}
+};
+
+error_t parseOpt(int key, char *arg, argp_state *state)
+{
+    ProgramOptions* options = reinterpret_cast<ProgramOptions*>(state->input);
+
+    switch (key)
+    {
+    case 'o':
+        options->output = arg;
+        break;
+    case OPT_THREADS:
+        options->threads = argToU16(arg, "threads");
+        break;
+    case OPT_CHUNK_SIZE:
+        options->chunkSize = argToU32(arg, "chunk-size");
+        break;
+    case OPT_NO_SPARSE:
+        options->sparse = false;
+        break;
+    case OPT_CHECKPOINT:
+        options->checkpoint = arg;
+        break;
+    case OPT_RESUME:
+        options->resume = true;
+        break;
+    case OPT_REBUILD:
+        options->rebuild = true;
+        options->rebuildDrive = arg ? argToU16(arg, "rebuild") : 0;
+        break;
+    case OPT_PARTIAL_REBUILD:
+        options->partialRebuild = true;
+        break;
+    case OPT_CLONE_METADATA:
+        options->cloneMetadata = true;
+        break;
+    case ARGP_KEY_INIT:
+        state->child_inputs[0] = &options->array;
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+std::unique_ptr<DriveReader> openRebuiltDrive(ProgramOptions& opts)
+{
+    auto& drives = opts.array.drives;
+    u16 drivenum;
+
+    if (opts.rebuildDrive > 0)
+    {
+        if (opts.rebuildDrive > drives.size())
+        {
+            throw std::invalid_argument("There's no drive " + std::to_string(opts.rebuildDrive) + " in the array.");
+        }
+        drivenum = opts.rebuildDrive - 1;
+    }
+    else
+    {
+        if (std::count(drives.begin(), drives.end(), "") != 1)
+        {
+            throw std::invalid_argument("Give position of drive to rebuild, like --rebuild=2, when there isn't exactly one missing drive.");
+        }
+        drivenum = std::find(drives.begin(), drives.end(), "") - drives.begin();
+    }
+
+    // Metadata has to be at the end of replacement drive, even if it's bigger than the old one
+    u64 size = 0;
+    struct stat st;
+    if (stat(opts.output.c_str(), &st) == 0 && S_ISBLK(st.st_mode))
+    {
+        size = BlockDeviceReader(opts.output).driveSize();
+    }
+
+    std::shared_ptr<SmartArrayReaderBase> array = openSmartArray(opts.array);
+    auto [areaStart, areaEnd] = array->rebuiltArea();
+    if (areaStart > 0 || areaEnd < array->memberDataSize())
+    {
+        std::string area = "Only bytes " + std::to_string(areaStart) + "-" + std::to_string(areaEnd) + " of " +
+                           std::to_string(array->memberDataSize()) + " bytes of member data can be rebuilt, the rest is written as zeros.";
+        if (!opts.partialRebuild)
+        {
+            throw std::invalid_argument(area + " Other logical drives on the array would be lost. Use --partial-rebuild to write it anyway.");
+        }
+        std::cerr << "WARNING: " << area << " Other logical drives on the array won't be readable." << std::endl;
+    }
+
+    if (!opts.cloneMetadata)
+    {
+        std::cout << "Rebuilding drive " << drivenum + 1 << " to " << opts.output << " with empty metadata..." << std::endl;
+        return std::make_unique<RebuiltDriveReader>(array, drivenum, nullptr, 0, size);
+    }
+
+    u16 sourceNum = 0;
+    while (sourceNum < drives.size() && (sourceNum == drivenum || drives[sourceNum].empty()))
+    {
+        sourceNum++;
+    }
+    if (sourceNum == drives.size())
+    {
+        throw std::invalid_argument("There are no drives to copy metadata from.");
+    }
+
+    auto metadataSource = std::make_shared<BlockDeviceReader>(drives[sourceNum], opts.array.directIo);
+    std::cout << "Rebuilding drive " << drivenum + 1 << " to " << opts.output << " with metadata of drive " << sourceNum + 1 << "..." << std::endl;
+
+    return std::make_unique<RebuiltDriveReader>(array, drivenum, metadataSource, sourceNum, size);
+}
+
+int main(int argc, char** argv)
+{
+    ProgramOptions opts = {
+        .threads = 4,
+        .chunkSize = 8,
+        .sparse = true,
+        .resume = false,
+        .rebuild = false,
+        .rebuildDrive = 0,
+        .partialRebuild = false,
+        .cloneMetadata = false
+    };
+
+    static argp_child children[] = {
+        { .argp = &arrayArgp },
+        {0}
+    };
+
+    static argp argp = {
+        .options = options,
+        .parser = parseOpt,
+        .doc = "HP Smart Array Raid Reader, array extraction.\n\n"
+               "Copies whole logical drive to an image file or another drive, without nbd and kernel block layer. "
+               "Many chunks are read (and reconstructed) at once and written in order. Array options are the same as for hewlett-read.\n\n"
+               "Examples:\n"
+               "\thewlett-extract --raid 5 -o array.img /dev/sda X /dev/sdc /dev/sdd\n"
+               "\thewlett-extract --raid 6 -o /dev/sde --checkpoint copy.checkpoint /dev/sda /dev/sdb X /dev/sdd\n"
+               "\thewlett-extract --raid 6 -o /dev/sde --checkpoint copy.checkpoint --resume /dev/sda /dev/sdb X /dev/sdd\n"
+               "\thewlett-extract --raid 5 --rebuild -o /dev/sde /dev/sda X /dev/sdc /dev/sdd",
+        .children = children
+    };
+
+    int parseRet = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (parseRet != 0)
+    {
+        std::cerr << "Arguments parse error, see above." << std::endl;
+        return -1;
+    }
+
+    if (opts.output.empty())
+    {
+        std::cerr << "Error: Output wasn't provided, use --output." << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<DriveReader> reader;
+    try
+    {
+        reader = opts.rebuild ? openRebuiltDrive(opts) : openArray(opts.array);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    ImageExtractorOptions extractorOpts {
+        .outputPath = opts.output,
+        .chunkSize = opts.chunkSize * 1024 * 1024,
+        .threads = opts.threads,
+        // Zeros are looked for stripe by stripe, stripes of empty areas of the array are whole zeros
+        .sparseBlockSize = opts.sparse ? opts.array.stripeSize * 1024 : 0,
+        .checkpointPath = opts.checkpoint,
+        .resume = opts.resume
+    };
+
+    try
+    {
+        ImageExtractor extractor(*reader, extractorOpts);
+        bool done = extractor.run();
+        extractor.printSummary(std::cerr);
+        reader->printStats(std::cerr);
+
+        if (!done)
+        {
+            std::cerr << "Interrupted.";
+            if (!opts.checkpoint.empty())
+            {
+                std::cerr << " Add --resume to continue where it stopped.";
+            }
+            std::cerr << std::endl;
+            return 1;
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        if (!opts.checkpoint.empty())
+        {
+            std::cerr << "Progress was saved to " << opts.checkpoint << ", add --resume to continue." << std::endl;
+        }
+        return -1;
+    }
+
+    return 0;
+}
@@ -4,15 +4,11 @@
 #include <memory.h>
 #include <memory>
 #include <iostream>
+#include <sstream>
 #include <exception>
-#include <limits.h>
-#include "smart_array_raid_0_reader.hpp"
-#include "smart_array_raid_1_reader.hpp"
-#include "smart_array_raid_5_reader.hpp"
-#include "smart_array_raid_6_reader.hpp"
-#include "smart_array_raid_10_reader.hpp"
-#include "smart_array_raid_50_reader.hpp"
-#include "smart_array_raid_60_reader.hpp"
+#include <stdexcept>
+#include "array_options.hpp"
+#include "ublk_device.hpp"
 
 using namespace sg;
 
@@ -20,14 +16,11 @@ std::unique_ptr<DriveReader> reader;
 
 struct ProgramOptions
 {
-    /// @brief Stripe size in kilobytes
-    u32 stripeSize;
-    u16 parityDelay;
-    u16 raidLevel;
-    u16 parityGroups;
-    u64 size;
-    u64 offset;
-    std::vector<std::string> drives;
+    ArrayOptions array;
+    std::string backend;
+    u16 threads;
+    u16 connections;
+    bool splice;
     std::string outputDevice;
 };
 
@@ -37,126 +30,74 @@ int read(void *buf, u32 len, u64 offset, void *userdata)
     {
         return reader->read(buf, len, offset);
     }
-    catch (std::runtime_error& ex)
+    catch (std::exception& ex)
     {
-        std::cerr << "Runtime error occured while reading data: " << ex.what() << std::endl;
+        std::cerr << "Error occured while reading data: " << ex.what() << std::endl;
         return -1;
     }
 }
 
-// Argument parsing
-static argp_option options[] = {
-    { "stripe-size", 's', "256", 0, "Stripe size in KiB. Default: 256", 0 },
-    { "parity-delay", 'p', "16", 0, "Parity delay, P420 Controllers use parity delay for their RAID 5, read more: https://www.freeraidrecovery.com/library/delayed-parity.aspx. Default: 16", 0 },
-    { "delay", 'p', 0, OPTION_ALIAS, 0, 0 },
-    { "raid", 'r', "<level>", 0, "Raid level, required!", 0 },
-    { "output", 'o', "/dev/nbd0", 0, "Output device, it has to be /dev/nbdx. Default: /dev/nbd0", 0 },
-    { "parity-groups", 'g', "2", 0, "Parity groups in RAID 50 and 60", 0 },
-    { "size", 'S', "0", 0, "Size of logical drives, 0 is maximum possible. Default: 0" },
-    { "offset", 'O', "0", 0, "Offset on each physical drive, Default: 0" },
-    {0}
-};
-
-u16 argToU16(std::string arg, std::string argName)
+int map(buse_extent *extents, int maxExtents, u32 len, u64 offset, void *userdata)
 {
-    try 
-    {
-        unsigned num = std::stoul(arg);
-        if (num > USHRT_MAX)
-        {
-            throw std::out_of_range("Argument exceeds range");
-        }
-        return num;
-    }
-    catch(std::invalid_argument const& ex)
-    {
-        throw std::invalid_argument("Argument " + argName + " (value:" + arg + ") is invalid. It has to be unsigned 16 bit integer.");
-    }
-    catch(std::out_of_range const& ex)
-    {
-        throw std::out_of_range("Argument " + argName + " (value:" + arg + ") is too large!. It has to be unsigned 16 bit integer.");
-    }
-}
+    static thread_local std::vector<DriveExtent> driveExtents;
+    driveExtents.clear();
 
-u32 argToU32(std::string arg, std::string argName)
-{
-    try 
-    {
-        return std::stoul(arg);
-    }
-    catch(std::invalid_argument const& ex)
+    if (!reader->mapExtents(len, offset, driveExtents) || driveExtents.size() > static_cast<size_t>(maxExtents))
     {
-        throw std::invalid_argument("Argument " + argName + " (value:" + arg + ") is invalid. It has to be unsigned 32 bit integer.");
+        return -1;
     }
-    catch(std::out_of_range const& ex)
+
+    for (size_t i = 0; i < driveExtents.size(); i++)
     {
-        throw std::out_of_range("Argument " + argName + " (value:" + arg + ") is too large!. It has to be unsigned 32 bit integer.");
+        extents[i] = { driveExtents[i].fd, driveExtents[i].offset, driveExtents[i].len };
     }
+
+    return driveExtents.size();
 }
 
-u64 argToU64(std::string arg, std::string argName)
+// Argument parsing
+
+// Keys for options that have only long version
+enum LongOnlyOption
 {
-    try 
-    {
-        return std::stoull(arg);
-    }
-    catch(std::invalid_argument const& ex)
-    {
-        throw std::invalid_argument("Argument " + argName + " (value:" + arg + ") is invalid. It has to be unsigned 64 bit integer.");
-    }
-    catch(std::out_of_range const& ex)
-    {
-        throw std::out_of_range("Argument " + argName + " (value:" + arg + ") is too large!. It has to be unsigned 64 bit integer.");
-    }
-}
+    OPT_THREADS = 1100,
+    OPT_CONNECTIONS,
+    OPT_SPLICE,
+    OPT_BACKEND
+};
+
+static argp_option options[] = {
+    { "output", 'o', "/dev/nbd0", 0, "Output device, it has to be /dev/nbdx, or /dev/ublkbx with --backend=ublk (then free one is picked if not given). Default: /dev/nbd0", 0 },
+    { "threads", OPT_THREADS, "N", 0, "Number of threads serving nbd requests. Many requests are read at once and every one is replied as soon as it's ready, useful for random reads like fsck or copying files. Default: 1", 0 },
+    { "connections", OPT_CONNECTIONS, "N", 0, "Number of sockets between nbd device and hewlett-read, each one is served by its own thread (with its own --threads). Kernel spreads requests among them, so one serving thread is not a bottleneck for big arrays. Default: 1", 0 },
+    { "splice", OPT_SPLICE, 0, 0, "Reads which lie only on healthy drives are sent from drives to nbd socket with splice, without copying them thru hewlett-read's memory. It has no effect with --direct-io.", 0 },
+    { "backend", OPT_BACKEND, "nbd", 0, "How the array is exposed as block device. nbd - /dev/nbdx thru BUSE, ublk - /dev/ublkbx thru io_uring, needs ublk_drv module (Linux 6.0+) and serves requests with lower latency. With ublk every --threads thread has its own queue, --connections and --splice are ignored. Default: nbd", 0 },
+    {0}
+};
 
 error_t parseOpt(int key, char *arg, argp_state *state)
 {
     ProgramOptions* options = reinterpret_cast<ProgramOptions*>(state->input);
-    std::string argStr;
 
     switch (key)
     {
-    case 's':
-        options->stripeSize = argToU32(arg, "stripe-size");
-        break;
-    case 'p':
-        options->parityDelay = argToU16(arg, "parity-delay");
-        break;
-    case 'r':
-        options->raidLevel = argToU16(arg, "raid");
-        break;
     case 'o':
         options->outputDevice = arg;
         break;
-    case 'g':
-        options->parityGroups = argToU16(arg, "parity-groups");
+    case OPT_THREADS:
+        options->threads = argToU16(arg, "threads");
         break;
-    case 'S':
-        options->size = argToU64(arg, "size");
+    case OPT_CONNECTIONS:
+        options->connections = argToU16(arg, "connections");
         break;
-    case 'O':
-        options->offset = argToU64(arg, "offset");
+    case OPT_SPLICE:
+        options->splice = true;
         break;
-    case ARGP_KEY_ARG:
-        if (state->arg_num > 256)
-        {
-            throw std::invalid_argument("Too many arguments.");
-        }
-        argStr = arg;
-        if (argStr == "X")
-        {
-            argStr.clear();
-        }
-
-        options->drives.push_back(argStr);
+    case OPT_BACKEND:
+        options->backend = arg;
         break;
-    case ARGP_KEY_END:
-        if (state->arg_num < 1)
-        {
-            std::cerr << "Not enough arguments." << std::endl;
-            argp_usage(state);
-        }
+    case ARGP_KEY_INIT:
+        state->child_inputs[0] = &options->array;
         break;
 
     default:
@@ -166,132 +107,54 @@ error_t parseOpt(int key, char *arg, argp_state *state)
     return 0;
 }
 
-void drivesPathVectorToDeviceReaderVector(
-    std::vector<std::string>& paths,
-    std::vector<std::shared_ptr<DriveReader>>& out)
+int serveUblk(ProgramOptions &opts)
 {
-    for (auto& path : paths)
-    {
-        if (!path.empty())
-        {
-            out.push_back(std::make_shared<BlockDeviceReader>(path));
-        }
-        else
-        {
-            // Reader should handle this
-            out.push_back(nullptr);
-        }
-    }
-}
-
-void initForRaid0(ProgramOptions &opts)
-{
-    SmartArrayRaid0ReaderOptions readerOpts {
-        .stripeSize = opts.stripeSize,
-        .size = opts.size,
-        .offset = opts.offset
-    };
-
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
-    
-    reader = std::make_unique<SmartArrayRaid0Reader>(readerOpts);
-}
-
-
-void initForRaid1(ProgramOptions &opts)
-{
-    SmartArrayRaid1ReaderOptions readerOpts {
-        .size = opts.size,
-        .offset = opts.offset
-    };
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
-    reader = std::make_unique<SmartArrayRaid1Reader>(readerOpts);
-}
-
-void initForRaid5(ProgramOptions &opts)
-{
-    SmartArrayRaid5ReaderOptions readerOpts {
-        .stripeSize = opts.stripeSize,
-        .parityDelay = opts.parityDelay,
-        .size = opts.size,
-        .offset = opts.offset
-    };
-
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
-
-    reader = std::make_unique<SmartArrayRaid5Reader>(readerOpts);
-}
-
-void initForRaid6(ProgramOptions &opts)
-{
-    SmartArrayRaid6ReaderOptions readerOpts {
-        .stripeSize = opts.stripeSize,
-        .parityDelay = opts.parityDelay,
-        .size = opts.size,
-        .offset = opts.offset
-    };
-
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
-
-    reader = std::make_unique<SmartArrayRaid6Reader>(readerOpts);
-}
-
-void initForRaid10(ProgramOptions &opts)
-{
-    SmartArrayRaid10ReaderOptions readerOpts {
-        .stripeSize = opts.stripeSize,
-        .size = opts.size,
-        .offset = opts.offset
-    };
-
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
-
-    reader = std::make_unique<SmartArrayRaid10Reader>(readerOpts);
-}
-
-void initForRaid50(ProgramOptions &opts)
-{
-    SmartArrayRaid50ReaderOptions readerOpts {
-        .stripeSize = opts.stripeSize,
-        .parityDelay = opts.parityDelay,
-        .parityGroups = opts.parityGroups,
-        .size = opts.size,
-        .offset = opts.offset
+    UblkDeviceOptions ublkOpts {
+        .read = [](void *buf, u32 len, u64 offset) { return read(buf, len, offset, nullptr); },
+        .size = reader->driveSize(),
+        .queues = opts.threads
     };
 
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
-
-    reader = std::make_unique<SmartArrayRaid50Reader>(readerOpts);
-}
-
-void initForRaid60(ProgramOptions &opts)
-{
-    SmartArrayRaid60ReaderOptions readerOpts {
-        .stripeSize = opts.stripeSize,
-        .parityDelay = opts.parityDelay,
-        .parityGroups = opts.parityGroups,
-        .size = opts.size,
-        .offset = opts.offset
-    };
+    const std::string ublkPrefix = "/dev/ublkb";
+    if (opts.outputDevice.starts_with(ublkPrefix))
+    {
+        ublkOpts.deviceId = argToU16(opts.outputDevice.substr(ublkPrefix.size()), "output");
+    }
 
-    drivesPathVectorToDeviceReaderVector(opts.drives, readerOpts.driveReaders);
+    try
+    {
+        UblkDevice device(ublkOpts);
+        std::cout << "Attaching to " << device.blockDevicePath() << "..." << std::endl;
+        device.run();
+        reader->printStats(std::cerr);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
 
-    reader = std::make_unique<SmartArrayRaid60Reader>(readerOpts);
+    return 0;
 }
 
 int main(int argc, char** argv)
 {
     ProgramOptions opts = {
-        .stripeSize = 256,
-        .parityDelay = 16,
-        .raidLevel = 2137,
+        .backend = "nbd",
+        .threads = 1,
+        .connections = 1,
+        .splice = false,
         .outputDevice = "/dev/nbd0"
     };
 
+    static argp_child children[] = {
+        { .argp = &arrayArgp },
+        {0}
+    };
+
     static argp argp = {
         .options = options,
         .parser = parseOpt,
-        .args_doc = "DRIVE1 DRIVE2 ...DRIVEN",
         .doc = "HP Smart Array Raid Reader.\n\n"
                "Drives must be provided in valid order. If you forgot order of drives in the array then use "
                "a program packard-tell included with hewlett-read:\n"
@@ -301,7 +164,8 @@ int main(int argc, char** argv)
                "Examples:\n"
                "\thewlett-read --raid 5 /dev/sda /dev/sdb /dev/sdc /dev/sdd\n"
                "\thewlett-read --raid 5 /dev/sda X /dev/sdc /dev/sdd\n"
-               "\thewlett-read --raid 6 /dev/sda X /dev/sdc X"
+               "\thewlett-read --raid 6 /dev/sda X /dev/sdc X",
+        .children = children
     };
 
     int parseRet = argp_parse(&argp, argc, argv, 0, 0, &opts);
@@ -311,43 +175,43 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    switch (opts.raidLevel)
+    if (opts.backend == "ublk" && !UblkDevice::isSupported())
+    {
+        std::cerr << "Error: ublk is not available, load it with modprobe ublk_drv." << std::endl;
+        return -1;
+    }
+    else if (opts.backend != "ublk" && opts.backend != "nbd")
+    {
+        std::cerr << "Error: Unknown backend " << opts.backend << "." << std::endl;
+        return -1;
+    }
+
+    try
+    {
+        reader = openArray(opts.array);
+    }
+    catch (std::invalid_argument& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    if (opts.backend == "ublk")
     {
-        case 0:
-            initForRaid0(opts);
-            break;
-        case 1:
-            initForRaid1(opts);
-            break;
-        case 5:
-            initForRaid5(opts);
-            break;
-        case 6:
-            initForRaid6(opts);
-            break;
-        case 10:
-            initForRaid10(opts);
-            break;
-        case 50:
-            initForRaid50(opts);
-            break;
-        case 60:
-            initForRaid60(opts);
-            break;
-        case 2137:
-            std::cerr << "Error: No RAID level was provided." << std::endl;
-            return -1;
-        default:
-            std::cerr << "RAID " << opts.raidLevel << " is not supported." << std::endl;
-            return -1;
+        return serveUblk(opts);
     }
 
     buse_operations ops = {
         .read = read,
+        .map = opts.splice ? map : nullptr,
         .size = reader->driveSize(),
-        .blksize = 512
+        .blksize = 512,
+        .threads = opts.threads,
+        .connections = opts.connections
     };
 
     std::cout << "Attaching to " << opts.outputDevice << "..." << std::endl;
-    buse_main(opts.outputDevice.c_str(), &ops, NULL);
+    int ret = buse_main(opts.outputDevice.c_str(), &ops, NULL);
+    reader->printStats(std::cerr);
+    return ret;
 }
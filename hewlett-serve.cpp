@@ -0,0 +1,135 @@
+#include <argp.h>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include "array_options.hpp"
+#include "nbd_server.hpp"
+
+using namespace sg;
+
+struct ProgramOptions
+{
+    ArrayOptions array;
+    std::string socketPath;
+    std::string address;
+    u16 port;
+    std::string exportName;
+};
+
+// Argument parsing
+
+// Keys for options that have only long version
+enum LongOnlyOption
+{
+    OPT_EXPORT_NAME = 1100
+};
+
+static argp_option options[] = {
+    { "socket", 'u', "PATH", 0, "Listen on unix socket at PATH instead of TCP.", 0 },
+    { "address", 'a', "127.0.0.1", 0, "Address to listen on, empty for all addresses. Default: 127.0.0.1", 0 },
+    { "port", 'P', "10809", 0, "TCP port to listen on. Default: 10809", 0 },
+    { "export-name", OPT_EXPORT_NAME, "NAME", 0, "Name of the export shown to clients listing exports. Clients may ask for any name. Default: empty", 0 },
+    {0}
+};
+
+error_t parseOpt(int key, char *arg, argp_state *state)
+{
+    ProgramOptions* options = reinterpret_cast<ProgramOptions*>(state->input);
+
+    switch (key)
+    {
+    case 'u':
+        options->socketPath = arg;
+        break;
+    case 'a':
+        options->address = arg;
+        break;
+    case 'P':
+        options->port = argToU16(arg, "port");
+        break;
+    case OPT_EXPORT_NAME:
+        options->exportName = arg;
+        break;
+    case ARGP_KEY_INIT:
+        state->child_inputs[0] = &options->array;
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    ProgramOptions opts = {
+        .address = "127.0.0.1",
+        .port = 10809
+    };
+
+    static argp_child children[] = {
+        { .argp = &arrayArgp },
+        {0}
+    };
+
+    static argp argp = {
+        .options = options,
+        .parser = parseOpt,
+        .doc = "HP Smart Array Raid Reader as NBD server.\n\n"
+               "Serves the array read only to any nbd client (nbd-client, qemu, nbdcopy) over TCP or unix socket, "
+               "without root and nbd kernel module. Array options are the same as for hewlett-read.\n\n"
+               "Examples:\n"
+               "\thewlett-serve --raid 5 /dev/sda X /dev/sdc /dev/sdd\n"
+               "\thewlett-serve --raid 5 --socket /tmp/array.sock /dev/sda /dev/sdb /dev/sdc /dev/sdd\n"
+               "\tnbdcopy nbd+unix:///?socket=/tmp/array.sock array.img",
+        .children = children
+    };
+
+    int parseRet = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (parseRet != 0)
+    {
+        std::cerr << "Arguments parse error, see above." << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<DriveReader> reader;
+    try
+    {
+        reader = openArray(opts.array);
+    }
+    catch (std::invalid_argument& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    NbdServerOptions serverOpts {
+        .exportName = opts.exportName
+    };
+
+    try
+    {
+        NbdServer server(*reader, serverOpts);
+        if (!opts.socketPath.empty())
+        {
+            server.listenUnix(opts.socketPath);
+            std::cout << "Listening on " << opts.socketPath << "..." << std::endl;
+        }
+        else
+        {
+            server.listenTcp(opts.address, opts.port);
+            std::cout << "Listening on " << opts.address << ":" << opts.port << "..." << std::endl;
+        }
+        server.run();
+        reader->printStats(std::cerr);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <argp.h>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include "array_options.hpp"
+#include "parity_scrubber.hpp"
+
+using namespace sg;
+
+struct ProgramOptions
+{
+    ArrayOptions array;
+    std::string output;
+    u16 threads;
+};
+
+// Argument parsing
+
+// Keys for options that have only long version
+enum LongOnlyOption
+{
+    OPT_THREADS = 1100
+};
+
+static argp_option options[] = {
+    { "output", 'o', "FILE", 0, "Save rows with mismatching parity to FILE, it can be given to other programs with --bad-rows.", 0 },
+    { "threads", OPT_THREADS, "N", 0, "Number of batches of rows verified at once. Default: 4", 0 },
+    {0}
+};
+
+error_t parseOpt(int key, char *arg, argp_state *state)
+{
+    ProgramOptions* options = reinterpret_cast<ProgramOptions*>(state->input);
+
+    switch (key)
+    {
+    case 'o':
+        options->output = arg;
+        break;
+    case OPT_THREADS:
+        options->threads = argToU16(arg, "threads");
+        break;
+    case ARGP_KEY_INIT:
+        state->child_inputs[0] = &options->array;
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    ProgramOptions opts = {
+        .threads = 4
+    };
+
+    static argp_child children[] = {
+        { .argp = &arrayArgp },
+        {0}
+    };
+
+    static argp argp = {
+        .options = options,
+        .parser = parseOpt,
+        .doc = "HP Smart Array Raid Reader, parity verification.\n\n"
+               "Reads every row of stripes of RAID 5 or 6 array and checks if parity matches the data, "
+               "so you know if data reconstructed for missing drive can be trusted. With one drive missing "
+               "RAID 6 is verified with Q parity. Array options are the same as for hewlett-read.\n\n"
+               "Exit code is 0 if parity matches everywhere, 2 if there are mismatching rows and 1 if it was interrupted.\n\n"
+               "Examples:\n"
+               "\thewlett-verify --raid 5 /dev/sda /dev/sdb /dev/sdc /dev/sdd\n"
+               "\thewlett-verify --raid 6 -o bad-rows.txt /dev/sda /dev/sdb X /dev/sdd",
+        .children = children
+    };
+
+    int parseRet = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (parseRet != 0)
+    {
+        std::cerr << "Arguments parse error, see above." << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<SmartArrayReaderBase> array;
+    try
+    {
+        array = openSmartArray(opts.array);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+
+    ParityScrubberOptions scrubberOpts {
+        .threads = opts.threads
+    };
+
+    try
+    {
+        ParityScrubber scrubber(*array, scrubberOpts);
+        bool done = scrubber.run();
+        scrubber.printSummary(std::cerr);
+
+        const BadRowList& badRows = scrubber.badRows();
+        for (auto& range : badRows.ranges())
+        {
+            std::cout << "Rows " << range.firstRow << " - " << range.lastRow
+                      << " (bytes " << range.driveOffset << " - " << range.driveEnd << " of every drive): "
+                      << (range.parityMismatch ? "P" : "") << (range.reedSolomonMismatch ? "Q" : "")
+                      << " doesn't match data" << std::endl;
+        }
+
+        if (!opts.output.empty())
+        {
+            badRows.save(opts.output);
+        }
+
+        if (!done)
+        {
+            std::cerr << "Interrupted, only part of the array was verified." << std::endl;
+            return 1;
+        }
+
+        return badRows.empty() ? 0 : 2;
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return -1;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.hpp"
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace sg
+{
+
+/// @brief Pool of equally sized, aligned buffers. Buffers are allocated only
+/// when pool is empty and are reused afterwards, so memory usage stays at
+/// the number of buffers used at the same time. It's thread safe.
+class AlignedBufferPool
+{
+public:
+    class Buffer
+    {
+    public:
+        Buffer(AlignedBufferPool& pool, char* data);
+        ~Buffer();
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        char* data();
+        size_t size();
+
+    private:
+        AlignedBufferPool& pool;
+        char* ptr;
+    };
+
+    AlignedBufferPool(size_t bufferSize, size_t alignment);
+    ~AlignedBufferPool();
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    /// @brief Takes buffer from the pool, it's returned when Buffer is destroyed.
+    Buffer acquire();
+    size_t bufferSize();
+
+private:
+    size_t size;
+    size_t alignment;
+    std::mutex mutex;
+    std::vector<char*> freeBuffers;
+
+    void release(char* data);
+};
+
+} // end namespace sg
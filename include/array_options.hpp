@@ -0,0 +1,61 @@
+#pragma once
+
+#include "types.hpp"
+#include "drive_reader.hpp"
+#include "smart_array_reader_base.hpp"
+#include <argp.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace sg
+{
+
+/// @brief Marks that --raid wasn't given
+const u16 NO_RAID_LEVEL = 2137;
+
+/// @brief How the array looks and how its drives are read, shared by hewlett-read and hewlett-serve.
+struct ArrayOptions
+{
+    /// @brief Stripe size in kilobytes
+    u32 stripeSize = 256;
+    u16 parityDelay = 16;
+    u16 raidLevel = NO_RAID_LEVEL;
+    u16 parityGroups = 2;
+    u64 size = 0;
+    u64 offset = 0;
+    bool directIo = false;
+    std::string ioEngine = "sync";
+    u16 ioThreads = 0;
+    /// @brief Size of stripe cache in MiB, 0 disables it
+    u64 cacheSize = 0;
+    /// @brief Rows read ahead of sequential streams, 0 disables readahead
+    u32 readahead = 0;
+    /// @brief Bad row list saved by hewlett-verify, empty if there's none
+    std::string badRowsPath;
+    /// @brief ddrescue mapfiles of drive images, by position of the drive counting from 1
+    std::map<u16, std::string> mapfiles;
+    /// @brief Race reads of slow drives with reconstruction, see SmartArrayReaderBase::enableHedging
+    bool hedge = false;
+    std::vector<u8> reedSolomonCoefficients;
+    std::vector<std::string> drives;
+};
+
+/// @brief Parser of array options and drive paths. Include it as the first child of program's argp
+/// and put pointer to ArrayOptions into state->child_inputs[0] on ARGP_KEY_INIT.
+extern const argp arrayArgp;
+
+/// @brief Sets up io engine and assembles reader of the array, with stripe cache in front of it if it's enabled.
+/// Throws std::invalid_argument if options don't describe supported array.
+std::unique_ptr<DriveReader> openArray(const ArrayOptions& options);
+
+/// @brief Like openArray, but without stripe cache, for things reading member drives rather than the logical drive.
+std::unique_ptr<SmartArrayReaderBase> openSmartArray(const ArrayOptions& options);
+
+u16 argToU16(std::string arg, std::string argName);
+u32 argToU32(std::string arg, std::string argName);
+u64 argToU64(std::string arg, std::string argName);
+std::vector<u8> argToU8List(std::string arg, std::string argName);
+
+} // end namespace sg
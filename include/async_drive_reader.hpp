@@ -0,0 +1,56 @@
+#pragma once
+
+#include "drive_reader.hpp"
+#include "types.hpp"
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace sg
+{
+
+struct ReadRequest
+{
+    DriveReader* drive;
+    void* buf;
+    u32 len;
+    u64 offset;
+
+    // If set, len bytes from offset are scattered across these buffers instead of buf.
+    // buf then points to the first of them.
+    const iovec* iov = nullptr;
+    int iovcnt = 0;
+};
+
+/// @brief Reads request with DriveReader::read or readv, in calling thread.
+void readRequest(ReadRequest& request);
+
+/// @brief Called for every request as soon as it's read. It's always called
+/// from the thread that called readAll, one request at a time.
+typedef std::function<void(ReadRequest&)> ReadCompletedCallback;
+
+/// @brief Reads many requests, usually from different drives, at once.
+/// RAID readers collect all segments of one logical read and pass them here,
+/// so all drives can work at the same time instead of one after another.
+class AsyncDriveReader
+{
+public:
+    /// @brief Submits all requests and waits until every one of them is completed.
+    /// Throws std::runtime_error if any of them has failed.
+    /// @param onCompleted optional, called for every successfully read request.
+    virtual void readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted = nullptr) = 0;
+    virtual inline ~AsyncDriveReader() {};
+};
+
+/// @brief Reads requests one after another, it's just calling DriveReader::read.
+class SequentialDriveReader : public AsyncDriveReader
+{
+public:
+    void readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted = nullptr) override;
+};
+
+/// @brief Async reader used by RAID readers created after this call.
+void setDefaultAsyncReader(std::shared_ptr<AsyncDriveReader> reader);
+std::shared_ptr<AsyncDriveReader> getDefaultAsyncReader();
+
+} // end namespace sg
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "types.hpp"
+#include <string>
+#include <vector>
+
+namespace sg
+{
+
+/// @brief Rows of stripes following each other, whose parity doesn't match their data.
+struct BadRowRange
+{
+    u64 firstRow;
+    u64 lastRow;
+    /// @brief Where the rows are on every member drive, from driveOffset to driveEnd
+    u64 driveOffset;
+    u64 driveEnd;
+    bool parityMismatch;
+    bool reedSolomonMismatch;
+};
+
+/// @brief Rows found inconsistent by parity scrub, saved to a file, so later reads
+/// can tell when data they reconstruct comes from such row.
+/// File has one range per line: first row, last row, drive offsets and P, Q or PQ
+/// for mismatching parity. Lines starting with # are comments.
+class BadRowList
+{
+public:
+    /// @brief Adds row, rows have to be added in increasing order. Following rows with
+    /// the same mismatch are merged into one range.
+    void add(const BadRowRange& range);
+
+    bool contains(u64 row) const;
+    bool empty() const;
+    u64 rowCount() const;
+    const std::vector<BadRowRange>& ranges() const;
+
+    /// @brief Throws std::runtime_error if file can't be written.
+    void save(const std::string& path) const;
+    /// @brief Throws std::invalid_argument if file can't be read or it's not a bad row list.
+    static BadRowList load(const std::string& path);
+
+private:
+    std::vector<BadRowRange> badRanges;
+};
+
+} // end namespace sg
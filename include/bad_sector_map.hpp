@@ -0,0 +1,70 @@
+#pragma once
+
+#include "types.hpp"
+#include <map>
+#include <vector>
+#include <atomic>
+#include <ostream>
+#include <utility>
+#include <shared_mutex>
+
+namespace sg
+{
+
+/// @brief Unreadable ranges are looked for in pieces of this size, so one bad sector
+/// costs reconstruction of 4KiB and not of the whole stripe.
+const u32 BAD_SECTOR_PROBE_SIZE = 4096;
+
+/// @brief Ranges of member drives which failed to read, kept in memory so later reads
+/// of them go straight to reconstruction instead of waiting for the drive to fail again.
+/// It's thread safe, reads only take shared lock and nothing at all while map is empty.
+class BadSectorMap
+{
+public:
+    /// @brief Marks range as unreadable, it's merged with ranges it touches.
+    void add(u16 drivenum, u64 offset, u64 len);
+
+    bool overlaps(u16 drivenum, u64 offset, u32 len);
+
+    /// @brief Splits range into pieces which are and aren't bad and calls callback(offset, len, bad)
+    /// for every one of them, in order. Whole range is one good piece if there's nothing bad in it.
+    template<typename Callback>
+    void forEachPiece(u16 drivenum, u64 offset, u32 len, Callback&& callback)
+    {
+        if (!this->hasRanges)
+        {
+            callback(offset, len, false);
+            return;
+        }
+
+        u64 pos = offset;
+        for (auto& [start, end] : this->badPieces(drivenum, offset, len))
+        {
+            if (start > pos)
+            {
+                callback(pos, static_cast<u32>(start - pos), false);
+            }
+            callback(start, static_cast<u32>(end - start), true);
+            pos = end;
+        }
+        if (pos < offset + len)
+        {
+            callback(pos, static_cast<u32>(offset + len - pos), false);
+        }
+    }
+
+    bool empty();
+    void printStats(std::ostream& out);
+
+private:
+    std::shared_mutex mutex;
+    // For every drive start of bad range -> its end
+    std::vector<std::map<u64, u64>> ranges;
+    std::atomic<bool> hasRanges = false;
+
+    /// @brief Bad parts of the range as [start, end) pairs, collected under the lock,
+    /// so callbacks of forEachPiece can take their time without holding it.
+    std::vector<std::pair<u64, u64>> badPieces(u16 drivenum, u64 offset, u32 len);
+};
+
+} // end namespace sg
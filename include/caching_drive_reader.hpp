@@ -0,0 +1,72 @@
+#pragma once
+
+#include "drive_reader.hpp"
+#include "types.hpp"
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace sg
+{
+
+/// @brief Keeps recently read blocks of another reader in memory, least recently used ones are evicted.
+/// Put in front of RAID reader with block size equal to stripe size, so data which is read over and over
+/// (filesystem metadata, journals) is reconstructed only once. Blocks are spread over shards,
+/// each with its own lock and LRU list, so many threads can use it at once.
+class CachingDriveReader : public DriveReader
+{
+public:
+    /// @param blockSize size of cached block in bytes, misses are read in whole blocks
+    /// @param capacity memory for cached data in bytes
+    /// @param shards number of independently locked parts of the cache
+    CachingDriveReader(std::shared_ptr<DriveReader> reader, u32 blockSize, u64 capacity, u32 shards = 16);
+    CachingDriveReader(const CachingDriveReader&) = delete;
+    CachingDriveReader& operator=(const CachingDriveReader&) = delete;
+
+    int read(void* buf, u32 len, u64 offset) override;
+    /// @brief Mapped ranges are sent straight from drives, so they don't go thru the cache.
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 driveSize() override;
+    std::string name() override;
+    void printStats(std::ostream& out) override;
+
+    u64 hits();
+    u64 misses();
+
+private:
+    struct Entry
+    {
+        u64 block;
+        std::unique_ptr<char[]> data;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        // Most recently used at the front
+        std::list<Entry> lru;
+        std::unordered_map<u64, std::list<Entry>::iterator> index;
+    };
+
+    std::shared_ptr<DriveReader> reader;
+    u32 blockSize;
+    u64 size;
+    size_t blocksPerShard;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<u64> hitCount = 0;
+    std::atomic<u64> missCount = 0;
+
+    Shard& shardOf(u64 block);
+    /// @brief Copies part of cached block into out, returns false if block isn't cached.
+    bool lookup(u64 block, u32 from, u32 len, char* out);
+    bool contains(u64 block);
+    void insert(u64 block, const char* data);
+    /// @brief Size of the block, the last one of the drive can be shorter.
+    u32 blockLength(u64 block);
+};
+
+} // end namespace sg
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.hpp"
+#include "drive_reader.hpp"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sg
+{
+
+/// @brief Image of member drive made with GNU ddrescue, together with its mapfile.
+/// Areas ddrescue didn't rescue are zeros in the image, not data, so reading them fails
+/// like reading bad sectors of the drive. RAID 5 and 6 readers get them with unreadableRanges
+/// and reconstruct them from the other drives without touching the image.
+class DdrescueImageReader : public DriveReader
+{
+public:
+    /// @brief Throws std::invalid_argument if mapfile can't be read.
+    DdrescueImageReader(std::string path, std::string mapfilePath, bool directIo = false);
+
+    int read(void* buf, u32 len, u64 offset) override;
+    int readv(const iovec* iov, int iovcnt, u64 offset) override;
+    int fileDescriptorFor(const void* buf, u32 len, u64 offset) override;
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 driveSize() override;
+    std::vector<std::pair<u64, u64>> unreadableRanges() override;
+
+private:
+    std::unique_ptr<BlockDeviceReader> image;
+    // Start of area which wasn't rescued -> its end, areas don't overlap or touch
+    std::map<u64, u64> holes;
+
+    void loadMapfile(const std::string& mapfilePath);
+    void addHole(u64 start, u64 end);
+    bool isRescued(u64 offset, u64 len);
+    void checkRescued(u64 offset, u64 len);
+};
+
+} // end namespace sg
@@ -1,17 +1,52 @@
 #pragma once
 
 #include "types.hpp"
+#include "aligned_buffer_pool.hpp"
 #include <string>
-#include <fstream>
+#include <memory>
+#include <vector>
+#include <ostream>
+#include <sys/uio.h>
 
 namespace sg
 {
 
+/// @brief Range of a file descriptor, data of logical drive can be sent from it without reading it into memory.
+struct DriveExtent
+{
+    int fd;
+    u64 offset;
+    u32 len;
+};
+
 class DriveReader
 {
 public:
     virtual int read(void* buf, u32 len, u64 offset) = 0;
+
+    /// @brief Reads data starting at offset and scatters it across iov buffers,
+    /// one after another. Default implementation calls read() for every buffer.
+    virtual int readv(const iovec* iov, int iovcnt, u64 offset);
+
+    /// @brief Returns file descriptor from which this range can be read into buf
+    /// with plain pread, or -1 if it's not possible. Used by asynchronous readers.
+    virtual int fileDescriptorFor(const void* buf, u32 len, u64 offset);
+
+    /// @brief Appends ranges of file descriptors holding this range, in order of data.
+    /// Returns false if any part of it can't be taken straight from a file descriptor,
+    /// like stripe of missing drive. Default implementation always returns false.
+    virtual bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents);
+
     virtual u64 driveSize() = 0;
+
+    /// @brief Ranges of the drive known to hold no valid data, as [start, end) pairs in order,
+    /// like areas ddrescue couldn't rescue. RAID readers with redundancy reconstruct them
+    /// instead of reading them. Default implementation returns no ranges.
+    virtual std::vector<std::pair<u64, u64>> unreadableRanges();
+
+    /// @brief Prints counters gathered while reading, like cache hits. Default implementation prints nothing.
+    virtual void printStats(std::ostream& out);
+
     virtual inline ~DriveReader() {};
     virtual std::string name();
 
@@ -19,18 +54,43 @@ protected:
     std::string driveName;
 };
 
+/// @brief Reads drive using pread/preadv on a file descriptor.
+/// It doesn't keep any seek state so single reader can be used
+/// from many threads at once.
 class BlockDeviceReader : public DriveReader
 {
 public:
-    BlockDeviceReader(std::string path);
+    /// @param directIo open drive with O_DIRECT, so it's data won't end up in the page cache.
+    BlockDeviceReader(std::string path, bool directIo = false);
+    ~BlockDeviceReader();
+    BlockDeviceReader(const BlockDeviceReader&) = delete;
+    BlockDeviceReader& operator=(const BlockDeviceReader&) = delete;
+
     int read(void* buf, u32 len, u64 offset) override;
+    int readv(const iovec* iov, int iovcnt, u64 offset) override;
+    int fileDescriptorFor(const void* buf, u32 len, u64 offset) override;
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
     u64 driveSize() override;
 
 private:
     std::string path;
-    std::ifstream devstream;
+    int fd;
     u64 size;
-    u64 readDriveSize(std::string path);
+    bool directIo;
+
+    // O_DIRECT requires buffer, length and offset to be aligned to logical block size.
+    u32 logicalBlockSize;
+    std::unique_ptr<AlignedBufferPool> bouncePool;
+
+    u64 readDriveSize();
+    u32 readLogicalBlockSize();
+    bool isAligned(const void* buf, u64 len, u64 offset);
+    void readAligned(void* buf, u32 len, u64 offset);
+    /// @brief Reads up to len bytes, stops at the end of the drive if at least minLen bytes were read.
+    /// Returns number of bytes read.
+    u32 readAligned(void* buf, u32 len, u64 offset, u32 minLen);
+    void readThroughBounceBuffer(void* buf, u32 len, u64 offset);
+    [[noreturn]] void throwReadError(u64 offset, int error);
 };
 
-} // end namespace sg
\ No newline at end of file
+} // end namespace sg
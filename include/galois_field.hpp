@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace sg
+{
+
+// Arithmetic in GF(2^8) used by RAID 6 Reed Solomon (Q) drive.
+// Addition is just XOR, multiplication is done with precomputed tables.
+// P420 uses polynomial x^8 + x^6 + x^3 + x^2 + 1 (0x14D), not 0x11D known from Linux RAID.
+const u16 GF_POLYNOMIAL = 0x14D;
+
+u8 gfMultiply(u8 a, u8 b);
+u8 gfInverse(u8 a);
+
+// Region functions below use the widest PSHUFB variant supported
+// by the CPU (SSSE3, AVX2 or AVX-512), it's selected once at runtime.
+
+/// @brief out ^= coefficient * src, for every byte.
+void gfMultiplyXor(void* out, const void* src, u8 coefficient, size_t len);
+
+/// @brief out = coefficient * src, for every byte. out can be the same buffer as src.
+void gfMultiplyInto(void* out, const void* src, u8 coefficient, size_t len);
+
+/// @brief One of multiplication variants, out ^= coefficient * src like gfMultiplyXor,
+/// or out = coefficient * src like gfMultiplyInto if accumulate isn't set.
+struct GfKernel
+{
+    const char* name;
+    void (*function)(void* out, const void* src, u8 coefficient, size_t len, bool accumulate);
+};
+
+/// @brief Table based reference and every PSHUFB variant supported by the CPU, from the narrowest one.
+/// The last one is used by region functions. It's here for gf-bench.
+std::vector<GfKernel> gfKernels();
+
+/// @brief Name of the multiplication variant selected for this CPU.
+const char* gfKernelName();
+
+} // end namespace sg
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "types.hpp"
+#include "drive_reader.hpp"
+#include "aligned_buffer_pool.hpp"
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <ostream>
+
+namespace sg
+{
+
+struct ImageExtractorOptions
+{
+    /// @brief Image file (created if it doesn't exist) or block device at least as big as the array
+    std::string outputPath;
+    /// @brief Bytes read by one task and written at once, multiple of 4096
+    u32 chunkSize = 8 * 1024 * 1024;
+    /// @brief Chunks read at once, reader has to be thread safe
+    u32 threads = 4;
+    /// @brief All zero blocks of this size aren't written to image files, they are left as holes.
+    /// Block devices are always written whole. 0 disables it.
+    u32 sparseBlockSize = 0;
+    /// @brief File where progress is saved every checkpointInterval seconds, empty disables it
+    std::string checkpointPath;
+    u32 checkpointInterval = 10;
+    /// @brief Continue from checkpoint instead of starting from the beginning
+    bool resume = false;
+};
+
+/// @brief Copies whole logical drive into an image or another drive. Chunks are read
+/// by a pool of threads, many at once, and written in order by the calling thread,
+/// so output is written sequentially with big writes. Progress is printed to stderr.
+class ImageExtractor
+{
+public:
+    ImageExtractor(DriveReader& reader, const ImageExtractorOptions& options);
+    ~ImageExtractor();
+    ImageExtractor(const ImageExtractor&) = delete;
+    ImageExtractor& operator=(const ImageExtractor&) = delete;
+
+    /// @brief Copies the drive, throws std::runtime_error if reading or writing fails (checkpoint is saved first).
+    /// @return true if whole drive was copied, false if it was interrupted with SIGINT or SIGTERM.
+    bool run();
+
+    void printSummary(std::ostream& out);
+
+private:
+    struct Chunk
+    {
+        Chunk(AlignedBufferPool& pool) : buffer(pool.acquire()) {}
+
+        AlignedBufferPool::Buffer buffer;
+        u32 len = 0;
+    };
+
+    DriveReader& reader;
+    ImageExtractorOptions options;
+    int fd = -1;
+    u64 size;
+    bool sparse = false;
+
+    std::mutex mutex;
+    std::condition_variable chunkRead;
+    std::condition_variable chunkWritten;
+    // Read chunks waiting for their turn to be written, chunks are numbered from startOffset
+    std::map<u64, std::unique_ptr<Chunk>> readChunks;
+    u64 nextToRead = 0;
+    u64 nextToWrite = 0;
+    bool stopping = false;
+    std::exception_ptr readError;
+
+    u64 startOffset = 0;
+    u64 bytesWritten = 0;
+    u64 bytesSkipped = 0;
+    double seconds = 0;
+
+    void openOutput();
+    void readLoop(AlignedBufferPool& pool, u64 chunkCount);
+    void writeChunk(u64 offset, Chunk& chunk);
+    void writeAll(const char* buf, u64 len, u64 offset);
+    /// @brief Everything before this offset is written
+    u64 writtenUntil();
+
+    /// @brief Returns offset from which to continue, throws std::invalid_argument if checkpoint doesn't match the array.
+    u64 loadCheckpoint();
+    void saveCheckpoint(u64 offset);
+};
+
+} // end namespace sg
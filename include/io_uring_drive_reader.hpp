@@ -0,0 +1,27 @@
+#pragma once
+
+#include "async_drive_reader.hpp"
+#include "types.hpp"
+
+namespace sg
+{
+
+/// @brief Submits all requests to io_uring in one batch and waits for all of them.
+/// Talks with the kernel with raw syscalls, so liburing is not needed.
+/// Every thread gets its own ring, so it's safe to use from many threads.
+/// Requests to drives without file descriptor (like RAID readers) are read
+/// synchronously while the ring is working on the rest.
+class IoUringDriveReader : public AsyncDriveReader
+{
+public:
+    IoUringDriveReader(u32 queueDepth = 64);
+    void readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted = nullptr) override;
+
+    /// @brief Checks if running kernel supports io_uring with read operations used here.
+    static bool isSupported();
+
+private:
+    u32 queueDepth;
+};
+
+} // end namespace sg
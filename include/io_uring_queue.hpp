@@ -0,0 +1,118 @@
+#pragma once
+
+#include "types.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <stddef.h>
+
+namespace sg
+{
+
+/// @brief Submission and completion queues of one io_uring instance,
+/// mapped into our memory. Talks with the kernel with raw syscalls, so liburing is not needed.
+/// Not thread safe, every thread needs its own.
+class IoUringQueue
+{
+public:
+    /// @param flags IORING_SETUP_* flags, with IORING_SETUP_SQE128 submissions are 128 bytes big
+    IoUringQueue(u32 entries, u32 flags = 0);
+    ~IoUringQueue();
+
+    IoUringQueue(const IoUringQueue&) = delete;
+    IoUringQueue& operator=(const IoUringQueue&) = delete;
+
+    u32 capacity()
+    {
+        return this->sqEntries;
+    }
+
+    /// @brief Puts read into submission queue, it's not sent to the kernel until submit.
+    void queueRead(int fd, void* buf, u32 len, u64 offset, u64 userData)
+    {
+        this->queue(IORING_OP_READ, fd, reinterpret_cast<u64>(buf), len, offset, userData);
+    }
+
+    /// @brief Same as queueRead, but data is scattered across iov buffers.
+    void queueReadv(int fd, const iovec* iov, int iovcnt, u64 offset, u64 userData)
+    {
+        this->queue(IORING_OP_READV, fd, reinterpret_cast<u64>(iov), iovcnt, offset, userData);
+    }
+
+    /// @brief Queues command for a driver (IORING_OP_URING_CMD), cmd is copied into the submission.
+    /// It has 16 bytes for cmd, or 80 bytes if the ring was set up with IORING_SETUP_SQE128.
+    void queueCommand(int fd, u32 cmdOp, const void* cmd, size_t cmdSize, u64 userData)
+    {
+        io_uring_sqe* sqe = this->queue(IORING_OP_URING_CMD, fd, 0, 0, 0, userData);
+        sqe->cmd_op = cmdOp;
+        memcpy(sqe->cmd, cmd, cmdSize);
+    }
+
+    io_uring_sqe* queue(u8 opcode, int fd, u64 addr, u32 len, u64 offset, u64 userData)
+    {
+        u32 tail = *this->sqTail;
+        u32 index = tail & this->sqMask;
+        io_uring_sqe* sqe = reinterpret_cast<io_uring_sqe*>(reinterpret_cast<char*>(this->sqes) + index * this->sqeSize);
+
+        memset(sqe, 0, this->sqeSize);
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = addr;
+        sqe->len = len;
+        sqe->off = offset;
+        sqe->user_data = userData;
+
+        this->sqArray[index] = index;
+        __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+        this->queued++;
+        return sqe;
+    }
+
+    /// @brief Asks the kernel if it knows the opcode (IORING_REGISTER_PROBE). Probing itself came in Linux 5.6,
+    /// on older kernels it's false for every opcode.
+    bool supportsOpcode(u8 opcode);
+
+    /// @brief Sends all queued submissions to the kernel and waits for at least minComplete completions.
+    void submit(u32 minComplete);
+
+    /// @brief Takes one completion from completion queue, returns false if there is none.
+    bool popCompletion(io_uring_cqe& out)
+    {
+        u32 head = *this->cqHead;
+        if (head == __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+
+        out = this->cqes[head & this->cqMask];
+        __atomic_store_n(this->cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int fd;
+    u32 queued = 0;
+
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize;
+    size_t sqeSize;
+
+    u32* sqHead;
+    u32* sqTail;
+    u32 sqMask;
+    u32* sqArray;
+    u32 sqEntries;
+
+    u32* cqHead;
+    u32* cqTail;
+    u32 cqMask;
+    io_uring_cqe* cqes;
+
+    void unmap();
+};
+
+} // end namespace sg
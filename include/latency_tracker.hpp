@@ -0,0 +1,66 @@
+#pragma once
+
+#include "types.hpp"
+#include <array>
+#include <vector>
+#include <mutex>
+#include <ostream>
+
+namespace sg
+{
+
+/// @brief What to do with a read of member drive, decided from its latency.
+enum class DrivePolicy
+{
+    /// @brief Read it like always
+    Read,
+    /// @brief Read it, but reconstruct data from the other drives if it doesn't come before the deadline
+    Hedge,
+    /// @brief Don't wait for the drive at all, reconstruct data from the other drives
+    Reconstruct
+};
+
+/// @brief Keeps average (EWMA) and histogram of read latency of every member drive and compares
+/// drives with each other. Drive much slower than the rest is hedged, and if it's really slow
+/// (dying drives often answer after seconds) it's demoted and treated like a missing one.
+/// Demoted drive still gets a read now and then, so it's promoted back when it recovers.
+class LatencyTracker
+{
+public:
+    /// @param maxDemoted how many drives can be demoted at once, the array has to be readable without them
+    LatencyTracker(u16 maxDemoted);
+
+    void record(u16 drivenum, u64 micros);
+    DrivePolicy policyFor(u16 drivenum);
+    bool isDemoted(u16 drivenum);
+
+    /// @brief How long to wait for a hedged read before reconstructing its data, in microseconds
+    u64 hedgeDeadline(u16 drivenum);
+
+    void printStats(std::ostream& out);
+
+private:
+    // Buckets of histogram are powers of 2 microseconds, the last one is 2^31 us (~36 minutes) and more
+    static const size_t HISTOGRAM_BUCKETS = 32;
+
+    struct DriveLatency
+    {
+        double average = 0;
+        u64 reads = 0;
+        u64 skipped = 0;
+        bool demoted = false;
+        std::array<u64, HISTOGRAM_BUCKETS> histogram = {};
+    };
+
+    std::mutex mutex;
+    std::vector<DriveLatency> drives;
+    u16 maxDemoted;
+    u16 demotedCount = 0;
+
+    DriveLatency& driveLatency(u16 drivenum);
+    /// @brief Median of averages of the other drives which were read enough times, 0 if there are none
+    double othersMedian(u16 drivenum);
+    u64 percentile(const DriveLatency& latency, double fraction);
+};
+
+} // end namespace sg
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "types.hpp"
+#include "drive_reader.hpp"
+#include <string>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+
+namespace sg
+{
+
+struct NbdServerOptions
+{
+    /// @brief Name clients see in NBD_OPT_LIST, clients can ask for any name tho
+    std::string exportName = "";
+    /// @brief Biggest read or cache request served, bigger ones get EINVAL (or EOVERFLOW)
+    u32 maxRequestSize = 32 * 1024 * 1024;
+};
+
+/// @brief Read only NBD server speaking fixed newstyle handshake, so any nbd client
+/// (nbd-client, qemu, nbdcopy) can read the array over unix or TCP socket without root.
+/// Supports structured replies, NBD_CMD_CACHE and NBD_CMD_BLOCK_STATUS with base:allocation.
+/// Every client is served by its own thread, reader has to be thread safe.
+class NbdServer
+{
+public:
+    NbdServer(DriveReader& reader, const NbdServerOptions& options);
+    ~NbdServer();
+    NbdServer(const NbdServer&) = delete;
+    NbdServer& operator=(const NbdServer&) = delete;
+
+    /// @brief Listens on unix socket, stale socket file at the path is removed.
+    void listenUnix(const std::string& path);
+    /// @brief Listens on TCP port of given address (IPv4 or IPv6, empty for all).
+    void listenTcp(const std::string& address, u16 port);
+
+    /// @brief Accepts clients until SIGINT or SIGTERM, then disconnects all of them.
+    void run();
+
+private:
+    DriveReader& reader;
+    NbdServerOptions options;
+    int listenFd = -1;
+    std::string unixPath;
+
+    std::mutex mutex;
+    std::condition_variable clientsDone;
+    std::set<int> clients;
+
+    void acceptLoop();
+    void serveClient(int fd);
+};
+
+} // end namespace sg
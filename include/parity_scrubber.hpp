@@ -0,0 +1,62 @@
+#pragma once
+
+#include "types.hpp"
+#include "smart_array_reader_base.hpp"
+#include "bad_row_list.hpp"
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <ostream>
+
+namespace sg
+{
+
+struct ParityScrubberOptions
+{
+    /// @brief Batches of rows verified at once
+    u32 threads = 4;
+    /// @brief Rows read from every drive with one request
+    u32 rowsPerTask = 8;
+};
+
+/// @brief Reads every row of stripes of RAID 5 or 6 array, data and parity, and checks if parity
+/// matches the data. Rows are verified by a pool of threads, progress is printed to stderr.
+class ParityScrubber
+{
+public:
+    ParityScrubber(SmartArrayReaderBase& array, const ParityScrubberOptions& options);
+    ParityScrubber(const ParityScrubber&) = delete;
+    ParityScrubber& operator=(const ParityScrubber&) = delete;
+
+    /// @brief Verifies the array, throws exception of verifyRows if it fails.
+    /// @return true if whole array was verified, false if it was interrupted with SIGINT or SIGTERM.
+    bool run();
+
+    /// @brief Mismatching rows in increasing order, from the part verified so far.
+    const BadRowList& badRows() const;
+
+    void printSummary(std::ostream& out);
+
+private:
+    SmartArrayReaderBase& array;
+    ParityScrubberOptions options;
+    u64 rows;
+
+    std::mutex mutex;
+    std::condition_variable workerDone;
+    u64 nextRow = 0;
+    u64 rowsVerified = 0;
+    u32 workersRunning = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::vector<BadRowList> workerBadRows;
+
+    BadRowList mergedBadRows;
+    double seconds = 0;
+
+    void verifyLoop(BadRowList& badRows);
+    void mergeBadRows();
+};
+
+} // end namespace sg
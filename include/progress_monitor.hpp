@@ -0,0 +1,59 @@
+#pragma once
+
+#include "types.hpp"
+#include <signal.h>
+#include <chrono>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+namespace sg
+{
+
+/// @brief Main loop helper of long running jobs, which work on a pool of threads. It blocks SIGINT and SIGTERM,
+/// threads started after it inherit the mask, so the signals can be checked only by the loop. Progress is printed
+/// to stderr once a second. Mask is restored when it's finished.
+class ProgressMonitor
+{
+public:
+    /// @param total amount of work, in units like rows or bytes
+    /// @param done amount done before, when job is resumed
+    /// @param bytesPerUnit bytes in one unit, for speed
+    /// @param describe returns text like "10 / 20 rows" for done and total amount
+    ProgressMonitor(u64 total, u64 done, u64 bytesPerUnit, std::function<std::string(u64 done, u64 total)> describe);
+    ~ProgressMonitor();
+    ProgressMonitor(const ProgressMonitor&) = delete;
+    ProgressMonitor& operator=(const ProgressMonitor&) = delete;
+
+    /// @brief Waits until predicate is true, but at most a second, so the loop can print progress and check signals.
+    template <typename Predicate>
+    void wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, Predicate predicate)
+    {
+        cv.wait_for(lock, std::chrono::seconds(1), predicate);
+    }
+
+    /// @brief Returns true if SIGINT or SIGTERM came, doesn't wait.
+    bool interrupted();
+
+    /// @brief Prints progress if at least a second passed since it was printed last time.
+    void update(u64 done);
+
+    /// @brief Restores signal mask and ends progress line. Returns seconds since the start.
+    double finish();
+
+private:
+    u64 total;
+    u64 bytesPerUnit;
+    std::function<std::string(u64, u64)> describe;
+    sigset_t signals;
+    sigset_t oldMask;
+    bool finished = false;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point lastProgress;
+    u64 lastProgressDone;
+    bool progressPrinted = false;
+};
+
+} // end namespace sg
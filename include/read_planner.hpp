@@ -0,0 +1,32 @@
+#pragma once
+
+#include "async_drive_reader.hpp"
+#include "types.hpp"
+#include <vector>
+#include <sys/uio.h>
+
+namespace sg
+{
+
+/// @brief Collects segments of one logical read and joins segments which lie
+/// right after each other on the same drive (like stripes of rows N and N+1)
+/// into one vectored request. So big sequential read across many stripe rows
+/// ends up as one read per member drive, scattered into the output buffer.
+class ReadPlanner
+{
+public:
+    /// @brief Segments of one drive have to be added in order of their offsets,
+    /// which is the case when logical read is walked from start to end.
+    void add(DriveReader* drive, void* buf, u32 len, u64 offset);
+
+    /// @brief Returns requests to read, they're valid until add is called again
+    /// or planner is destroyed.
+    std::vector<ReadRequest>& plan();
+
+private:
+    std::vector<ReadRequest> segments;
+    std::vector<iovec> iovecs;
+    std::vector<ReadRequest> requests;
+};
+
+} // end namespace sg
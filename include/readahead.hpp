@@ -0,0 +1,108 @@
+#pragma once
+
+#include "types.hpp"
+#include "aligned_buffer_pool.hpp"
+#include "thread_pool.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <ostream>
+
+namespace sg
+{
+
+/// @brief Detects sequential streams of reads and reads rows of stripes ahead of them in background,
+/// so when the next request comes its row is already read (and reconstructed).
+/// Up to MAX_STREAMS streams are tracked at once, so interleaved reads of several clients
+/// or nbd threads don't break each other's streams.
+class Readahead
+{
+public:
+    /// @brief Reads range of the array bypassing readahead, throws on failure. Called from many threads.
+    typedef std::function<void(void* buf, u32 len, u64 offset)> ReadFunction;
+
+    /// @param rowSize logical bytes in one row of stripes across all drives, rows are prefetched whole
+    /// @param depth how many rows are kept read ahead of every stream
+    Readahead(ReadFunction read, u64 rowSize, u32 depth, u64 driveSize);
+    ~Readahead();
+    Readahead(const Readahead&) = delete;
+    Readahead& operator=(const Readahead&) = delete;
+
+    /// @brief Reads range, taking prefetched rows where possible, and schedules prefetch if it continues a stream.
+    void read(void* buf, u32 len, u64 offset);
+
+    /// @brief Waits for prefetches being read, queued ones are dropped. Nothing is prefetched afterwards.
+    void stop();
+
+    void printStats(std::ostream& out);
+
+    static const size_t MAX_STREAMS = 8;
+    /// @brief Reads in a row after which the stream is considered sequential
+    static const u32 SEQUENTIAL_THRESHOLD = 2;
+
+private:
+    enum class RowState
+    {
+        Loading,
+        Ready,
+        Failed
+    };
+
+    struct Row
+    {
+        Row(AlignedBufferPool& pool, u32 len) : buffer(pool.acquire()), len(len) {}
+
+        AlignedBufferPool::Buffer buffer;
+        u32 len;
+        RowState state = RowState::Loading;
+        bool used = false;
+    };
+
+    struct Stream
+    {
+        u64 nextOffset;
+        u32 sequentialReads;
+        /// @brief Rows before this one were already scheduled
+        u64 prefetchedUntil;
+        u64 lastUse;
+    };
+
+    ReadFunction readFunction;
+    u64 rowSize;
+    u32 depth;
+    u64 size;
+
+    // Declared before rows, buffers of rows go back to it
+    AlignedBufferPool bufferPool;
+
+    std::mutex mutex;
+    std::condition_variable rowLoaded;
+    std::map<u64, std::shared_ptr<Row>> rows;
+    // Order in which rows were prefetched, oldest are evicted first
+    std::deque<u64> rowOrder;
+    std::vector<Stream> streams;
+    u64 useCounter = 0;
+    bool stopping = false;
+
+    std::atomic<u64> prefetchedRows = 0;
+    std::atomic<u64> unusedRows = 0;
+    std::atomic<u64> hits = 0;
+    std::atomic<u64> misses = 0;
+
+    // Destroyed first, so no prefetch runs while the rest is torn down
+    std::unique_ptr<ThreadPool> pool;
+
+    /// @brief Finds or starts stream for the read and returns rows which should be prefetched. Needs lock.
+    std::vector<u64> trackStream(u32 len, u64 offset);
+    void prefetch(u64 row, std::shared_ptr<Row> data);
+    /// @brief Removes row from the map if it's still the same one. Needs lock.
+    void dropRow(u64 row, const std::shared_ptr<Row>& data);
+    u32 rowLength(u64 row);
+};
+
+} // end namespace sg
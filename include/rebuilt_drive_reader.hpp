@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.hpp"
+#include "drive_reader.hpp"
+#include "smart_array_reader_base.hpp"
+#include <memory>
+#include <vector>
+
+namespace sg
+{
+
+/// @brief Controller keeps its metadata in last 32MiB of every member drive.
+const u64 MEMBER_METADATA_AREA_SIZE = 32 * 1024 * 1024;
+
+/// @brief Metadata itself starts 31MiB from the end of the drive, it's parsed by parseMetadata.
+const u64 MEMBER_METADATA_NEGATIVE_OFFSET = 31 * 1024 * 1024;
+
+/// @brief Raw content of member drive regenerated from the other ones, stripes (parity included)
+/// and the metadata area at the end, so it can be written to a replacement drive. Metadata area is empty,
+/// unless it's copied from a healthy member with drive number changed to the rebuilt one.
+class RebuiltDriveReader : public DriveReader
+{
+public:
+    /// @param drivenum index of rebuilt drive in the array
+    /// @param metadataSource healthy member of the array, metadata area is left empty if it's nullptr
+    /// @param metadataSourceNum its index in the array
+    /// @param size size of replacement drive, metadata goes to its end. Space between stripes and metadata
+    /// is filled with zeros. If it's 0, drive is as small as possible.
+    RebuiltDriveReader(std::shared_ptr<SmartArrayReaderBase> array, u16 drivenum,
+                       std::shared_ptr<DriveReader> metadataSource = nullptr, u16 metadataSourceNum = 0, u64 size = 0);
+
+    int read(void* buf, u32 len, u64 offset) override;
+    u64 driveSize() override;
+
+private:
+    std::shared_ptr<SmartArrayReaderBase> array;
+    u16 drivenum;
+    u64 size;
+    std::vector<u8> metadataArea;
+
+    /// @brief Finds number of rebuilt drive in logical drive the source belongs to and writes it into metadata.
+    /// Returns false if it can't be found.
+    bool setDriveNumber(u16 metadataSourceNum);
+};
+
+} // end namespace sg
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "types.hpp"
+#include <vector>
+#include <cstddef>
+
+namespace sg
+{
+
+/// @brief Alignment of scratch buffers, it's enough for O_DIRECT reads and any SIMD loads.
+const size_t SCRATCH_ALIGNMENT = 4096;
+
+/// @brief Memory is taken from the system in blocks of at least this size.
+const size_t SCRATCH_BLOCK_SIZE = 1024 * 1024 * 4;
+
+/// @brief Per thread memory for temporary buffers, like data of other drives read during recovery.
+/// Buffers are released in reverse order of allocation (by Frame), so it's just moving
+/// a pointer back and forth. Memory is kept until thread exits, so after the first few
+/// reads there are no heap allocations at all.
+class ScratchArena
+{
+public:
+    /// @brief Remembers position of the arena of current thread. Everything
+    /// allocated thru the frame is released when frame is destroyed.
+    /// Frames can be nested (recovery inside of recovery in RAID 50),
+    /// but inner frame must be destroyed first.
+    class Frame
+    {
+    public:
+        Frame();
+        ~Frame();
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        /// @brief Returns buffer of len bytes aligned to SCRATCH_ALIGNMENT.
+        /// It's valid until the frame is destroyed.
+        char* allocate(size_t len);
+
+    private:
+        ScratchArena& arena;
+        size_t block;
+        size_t used;
+    };
+
+    ScratchArena() = default;
+    ~ScratchArena();
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    static ScratchArena& forThisThread();
+
+private:
+    struct Block
+    {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t currentBlock = 0;
+    size_t used = 0;
+
+    char* allocate(size_t len);
+};
+
+} // end namespace sg
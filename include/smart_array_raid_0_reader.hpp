@@ -3,6 +3,8 @@
 #include <vector>
 #include <memory>
 #include "smart_array_reader_base.hpp"
+#include "read_planner.hpp"
+#include "stripe_geometry.hpp"
 #include "types.hpp"
 
 namespace sg
@@ -19,27 +21,31 @@ struct SmartArrayRaid0ReaderOptions
     u64 size = 0;
     u64 offset = 0;
     bool nometadata = false;
+    /// @brief Reads its drives on its own threads. For nested RAID levels, where drives are
+    /// RAID readers without file descriptor, so io_uring would read them one after another.
+    bool parallelDrives = false;
 };
 
 class SmartArrayRaid0Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid0Reader(const SmartArrayRaid0ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid0Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
+    /// @brief Prints stats of its drives too, they're RAID readers in nested RAID levels.
+    void printStats(std::ostream& out) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
 
 private:
     u32 stripeSizeInBytes;
 
     std::vector<std::shared_ptr<DriveReader>> drives;
+    std::unique_ptr<StripeGeometry> geometry;
 
-    // Stripes will be index from 0.
-    u64 stripeNumber(u64 offset);
-    u32 stripeRelativeOffset(u64 stripenum, u64 offset);
-    u16 stripeDriveNumber(u64 stripenum);
-    u64 stripeDriveOffset(u64 stripenum, u32 stripeRelativeOffset);
-    u32 lastRowStripeSize();
-    bool isLastRow(u64 rownum);
-    u32 readFromStripe(void* buf, u64 stripenum, u32 stripeRelativeOffset, u32 len);
+    u32 readFromStripe(void* buf, const StripeLocation& location, u32 len, ReadPlanner& planner);
 };
 
 } // end namespace sg
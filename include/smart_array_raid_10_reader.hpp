@@ -26,8 +26,15 @@ class SmartArrayRaid10Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid10Reader(const SmartArrayRaid10ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid10Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
     u64 driveSize() override;
+    void printStats(std::ostream& out) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
+
 private:
     std::unique_ptr<SmartArrayRaid0Reader> raid0Reader;
 };
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
 #include "smart_array_reader_base.hpp"
 #include "types.hpp"
 
@@ -21,10 +22,33 @@ class SmartArrayRaid1Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid1Reader(const SmartArrayRaid1ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid1Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
+    void printStats(std::ostream& out) override;
+    /// @brief Big vectored reads are split between mirrors like big reads. It's how RAID 10 reads
+    /// its mirror groups. With readahead enabled buffers are read one by one, so readahead sees them.
+    int readv(const iovec* iov, int iovcnt, u64 offset) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
 
 private:
     std::vector<std::shared_ptr<DriveReader>> drives;
+
+    // Reads being read from every mirror right now, and where the last one has ended
+    std::vector<std::atomic<u32>> readsInFlight;
+    std::vector<std::atomic<u64>> lastReadEnd;
+    std::vector<std::atomic<u64>> bytesRead;
+    std::atomic<u32> nextMirror = 0;
+
+    /// @brief Mirror continuing sequential stream which ends at driveOffset, or the least busy one.
+    u16 pickMirror(u64 driveOffset);
+    /// @brief Reads every part from mirror with the same index at once. If any of them fails,
+    /// all of them are read again with falling back to the other mirrors.
+    void readParts(std::vector<ReadRequest>& parts);
+    /// @brief Reads from mirror, if it fails the other mirrors are tried one after another.
+    int readFromMirror(u16 mirror, void* buf, u32 len, u64 driveOffset);
 };
 
 } // end namespace sg
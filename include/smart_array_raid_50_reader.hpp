@@ -28,8 +28,15 @@ class SmartArrayRaid50Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid50Reader(const SmartArrayRaid50ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid50Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
     u64 driveSize() override;
+    void printStats(std::ostream& out) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
+
 private:
     std::unique_ptr<SmartArrayRaid0Reader> raid0Reader;
 };
@@ -3,6 +3,8 @@
 #include <vector>
 #include <memory>
 #include "smart_array_reader_base.hpp"
+#include "read_planner.hpp"
+#include "stripe_geometry.hpp"
 #include "types.hpp"
 
 namespace sg
@@ -26,22 +28,23 @@ class SmartArrayRaid5Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid5Reader(const SmartArrayRaid5ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid5Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
+    void rebuildMember(void* buf, u16 drivenum, u32 len, u64 driveOffset) override;
+    void verifyRows(u64 firstRow, u32 count, BadRowList& badRows) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
+    u16 spareDrives() override;
 
 private:
     u32 stripeSizeInBytes;
-    u16 parityDelay;
 
     std::vector<std::shared_ptr<DriveReader>> drives;
+    std::unique_ptr<StripeGeometry> geometry;
 
-    // Stripes will be index from 0.
-    u64 stripeNumber(u64 offset);
-    u32 stripeRelativeOffset(u64 stripenum, u64 offset);
-    u16 stripeDriveNumber(u64 stripenum);
-    u64 stripeDriveOffset(u64 stripenum, u32 stripeRelativeOffset);
-    u32 lastRowStripeSize();
-    bool isLastRow(u64 rownum);
-    u32 readFromStripe(void* buf, u64 stripenum, u32 stripeRelativeOffset, u32 len);
+    u32 readFromStripe(void* buf, const StripeLocation& location, u32 len, ReadPlanner& planner);
     u32 recoverForDrive(void* buf, u16 drivenum, u64 driveOffset, u32 len);
 };
 
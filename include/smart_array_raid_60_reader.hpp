@@ -17,6 +17,9 @@ struct SmartArrayRaid60ReaderOptions
     u16 parityDelay;
     u16 parityGroups;
 
+    /// @brief Reed Solomon coefficients for data drives, empty means P420_REED_SOLOMON_COEFFICIENTS
+    std::vector<u8> reedSolomonCoefficients;
+
     /// @brief drives path
     std::vector<std::shared_ptr<DriveReader>> driveReaders;
     std::string readerName;
@@ -28,8 +31,15 @@ class SmartArrayRaid60Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid60Reader(const SmartArrayRaid60ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid60Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
     u64 driveSize() override;
+    void printStats(std::ostream& out) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
+
 private:
     std::unique_ptr<SmartArrayRaid0Reader> raid0Reader;
 };
@@ -2,12 +2,20 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "smart_array_reader_base.hpp"
+#include "read_planner.hpp"
+#include "stripe_geometry.hpp"
 #include "types.hpp"
 
 namespace sg
 {
 
+// Reed Solomon (Q) coefficient for every data drive in the row, P420 computes Q as
+// coef[0] * data0 ^ coef[1] * data1 ^ ... in GF(2^8), see galois_field.hpp.
+// Found from samples in raid-6-problem directory, so only for first 3 data drives.
+const std::vector<u8> P420_REED_SOLOMON_COEFFICIENTS = { 101, 186, 188 };
+
 struct SmartArrayRaid6ReaderOptions
 {
 
@@ -15,6 +23,9 @@ struct SmartArrayRaid6ReaderOptions
     u32 stripeSize;
     u16 parityDelay;
 
+    /// @brief Reed Solomon coefficients for data drives, empty means P420_REED_SOLOMON_COEFFICIENTS
+    std::vector<u8> reedSolomonCoefficients;
+
     /// @brief drives path
     std::vector<std::shared_ptr<DriveReader>> driveReaders;
     std::string readerName;
@@ -26,26 +37,32 @@ class SmartArrayRaid6Reader : public SmartArrayReaderBase
 {
 public:
     SmartArrayRaid6Reader(const SmartArrayRaid6ReaderOptions& options);
-    int read(void *buf, u32 len, u64 offset) override;
+    ~SmartArrayRaid6Reader();
+    bool mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents) override;
+    u64 rowSize() override;
+    void rebuildMember(void* buf, u16 drivenum, u32 len, u64 driveOffset) override;
+    /// @brief Q depends on layout, which is known only for this logical drive, so only its rows are rebuilt.
+    std::pair<u64, u64> rebuiltArea() override;
+    void verifyRows(u64 firstRow, u32 count, BadRowList& badRows) override;
+
+protected:
+    int readArray(void *buf, u32 len, u64 offset) override;
+    u16 spareDrives() override;
 
 private:
     u32 stripeSizeInBytes;
-    u16 parityDelay;
+    std::vector<u8> reedSolomonCoefficients;
 
     std::vector<std::shared_ptr<DriveReader>> drives;
+    std::unique_ptr<StripeGeometry> geometry;
+    std::once_flag reedSolomonNotVerifiedWarning;
 
-    // Stripes will be index from 0.
-    u64 stripeNumber(u64 offset);
-    u32 stripeRelativeOffset(u64 stripenum, u64 offset);
-    u16 stripeDriveNumber(u64 stripenum);
-    u64 stripeDriveOffset(u64 stripenum, u32 stripeRelativeOffset);
-    u32 readFromStripe(void* buf, u64 stripenum, u32 stripeRelativeOffset, u32 len);
-    bool isReedSolomonDrive(u16 drivenum, u64 driveOffset);
-    bool isParityDrive(u16 drivenum, u64 driveOffset);
-    u32 lastRowStripeSize();
-    bool isLastRow(u64 rownum);
+    u32 readFromStripe(void* buf, const StripeLocation& location, u32 len, ReadPlanner& planner);
+    u8 reedSolomonCoefficient(u16 drivenum, u64 driveOffset);
     u32 recoverForDrive(void* buf, u16 drivenum, u64 driveOffset, u32 len);
     u32 recoverForTwoDrives(void* buf, u16 drive1num, u16 drive2num, u64 driveOffset, u32 len);
+    /// @brief Rebuilds part of one stripe of member drive, computing P or Q again if it's there.
+    void rebuildStripe(void* buf, u16 drivenum, u32 len, u64 driveOffset);
 };
 
 } // end namespace sg
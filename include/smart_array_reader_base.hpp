@@ -1,7 +1,18 @@
 #pragma once
 
 #include "drive_reader.hpp"
+#include "async_drive_reader.hpp"
+#include "readahead.hpp"
+#include "stripe_geometry.hpp"
+#include "bad_row_list.hpp"
+#include "bad_sector_map.hpp"
+#include "latency_tracker.hpp"
+#include "thread_pool.hpp"
 #include "types.hpp"
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <functional>
 
 namespace sg
 {
@@ -9,12 +20,98 @@ namespace sg
 class SmartArrayReaderBase : public DriveReader
 {
 public:
+    SmartArrayReaderBase();
+
+    /// @brief Reads through readahead if it's enabled, otherwise straight with readArray.
+    int read(void* buf, u32 len, u64 offset) override final;
     virtual u64 driveSize() override;
+    void printStats(std::ostream& out) override;
+
+    /// @brief Logical bytes in one row of stripes across all drives, it's unit of readahead.
+    virtual u64 rowSize() = 0;
+
+    /// @brief Starts prefetching rows ahead of sequential reads.
+    /// @param depth how many rows are read ahead of every stream, up to Readahead::MAX_STREAMS streams
+    void enableReadahead(u32 depth);
+
+    /// @brief Regenerates raw content of member drive from the other drives, parity stripes included,
+    /// so it can be written to a replacement drive. Throws std::invalid_argument if RAID level
+    /// or missing drives don't allow it. Default implementation always throws.
+    /// @param driveOffset physical offset on the member drive, whole range has to be below memberDataSize()
+    virtual void rebuildMember(void* buf, u16 drivenum, u32 len, u64 driveOffset);
+
+    /// @brief Bytes at the beginning of every member drive, which hold stripes. Controller metadata follows them.
+    u64 memberDataSize();
+
+    /// @brief Part of member drive, from first to second, which rebuildMember really regenerates.
+    /// The rest of memberDataSize() is written as zeros. Default is the whole data area.
+    virtual std::pair<u64, u64> rebuiltArea();
+
+    /// @brief Rows of stripes the logical drive takes on every member drive, the last one may be partially used.
+    u64 stripeRows();
+
+    /// @brief Checks whether parity of rows from firstRow to firstRow + count - 1 matches their data,
+    /// and adds mismatching rows to the list. Throws std::invalid_argument if RAID level
+    /// or missing drives don't allow it. Default implementation always throws.
+    virtual void verifyRows(u64 firstRow, u32 count, BadRowList& badRows);
+
+    /// @brief Reconstructing data from rows on the list is counted and reported, as it may be wrong.
+    void setBadRows(std::shared_ptr<const BadRowList> badRows);
+
+    /// @brief Starts tracking read latency of member drives. Reads of drive much slower than the others
+    /// are raced with reconstruction from the other drives, and really slow drive is treated as missing
+    /// until it gets better. Throws std::invalid_argument if the array can't lose any more drives.
+    void enableHedging();
 
 protected:
+    /// @brief Reads range of the array, what read() of other readers does.
+    virtual int readArray(void* buf, u32 len, u64 offset) = 0;
+
+    /// @brief Waits for background reads, so they don't run on a half destroyed reader.
+    /// Every reader has to call it in its destructor.
+    void stopReadahead();
+
+    /// @brief Call when data of the row is reconstructed, it's reported if the row is on bad row list.
+    void checkBadRow(u64 row);
+
+    /// @brief Reconstructs range of member drive from the other drives.
+    typedef std::function<void(void* buf, u16 drivenum, u64 driveOffset, u32 len)> RecoverFunction;
+
+    /// @brief Reads requests of member drives all at once. If any of them fails, its segments are read
+    /// again one by one, pieces which still can't be read are reconstructed with recover and added to badSectors.
+    void readMembers(std::vector<ReadRequest>& requests, const std::vector<std::shared_ptr<DriveReader>>& drives,
+                     const RecoverFunction& recover);
+
+    /// @brief Adds unreadableRanges of every drive to badSectors, so they're reconstructed from the start.
+    /// Warns if there are no spareDrives() to reconstruct them from. Call it when drives are set.
+    void addUnreadableRanges(const std::vector<std::shared_ptr<DriveReader>>& drives);
+
+    /// @brief How many more drives can be missing and the array can be still read, used by hedging. Default is 0.
+    virtual u16 spareDrives();
+
+    /// @brief Drive is so slow that it's treated as missing, recovery shouldn't read it either.
+    bool isDemoted(u16 drivenum);
+
+    bool readaheadEnabled();
+
+    /// @brief mapExtents of striped levels. Walks stripes of the range and maps each of them
+    /// on its drive, it fails if any stripe is on missing drive or canMapDrive refuses it.
+    bool mapStripes(const StripeGeometry& geometry, const std::vector<std::shared_ptr<DriveReader>>& drives,
+                    u32 len, u64 offset, std::vector<DriveExtent>& extents);
+
+    /// @brief Whether range of member drive can be sent straight from the drive. By default it can't
+    /// if it has known bad sectors or the drive is demoted, as then it has to be reconstructed.
+    virtual bool canMapDrive(u16 drivenum, u64 driveOffset, u32 len);
+
+    // Unreadable ranges of member drives found so far, reads of them go straight to reconstruction
+    BadSectorMap badSectors;
+
     // Smallest drive in the array
     u64 singleDriveSize;
 
+    // Used to read all segments of one logical read at once
+    std::shared_ptr<AsyncDriveReader> asyncReader;
+
     /// @brief Sets size of logical drive, throws std::invalid_argument
     /// if provided size is bigger than maximum.
     /// @param size size in bytes
@@ -29,7 +126,29 @@ protected:
 
 private:
     u64 size;
-    u64 physicalDriveOffset;    
+    u64 physicalDriveOffset = 0;
+    std::unique_ptr<Readahead> readahead;
+    std::shared_ptr<const BadRowList> badRows;
+    std::atomic<u64> badRowReconstructions = 0;
+
+    // Read of slow drive racing with reconstruction, shared with pool thread which may finish it after it's abandoned
+    struct HedgedRead;
+
+    // Pool threads keep tracker alive, it's destroyed after them
+    std::shared_ptr<LatencyTracker> latency;
+    std::unique_ptr<ThreadPool> hedgePool;
+    std::atomic<u64> hedgedReads = 0;
+    std::atomic<u64> hedgesReconstructed = 0;
+    std::atomic<u64> demotedReads = 0;
+
+    /// @brief Reads requests all at once, if any of them fails segments are read one by one with readSegment.
+    void readBatch(std::vector<ReadRequest>& requests, const std::vector<std::shared_ptr<DriveReader>>& drives,
+                   const RecoverFunction& recover);
+    void readSegment(DriveReader* drive, u16 drivenum, void* buf, u32 len, u64 offset, const RecoverFunction& recover);
+    /// @brief Reconstructs every segment of the request instead of reading it.
+    void recoverRequest(const ReadRequest& request, u16 drivenum, const RecoverFunction& recover);
+    std::shared_ptr<HedgedRead> startHedgedRead(std::shared_ptr<DriveReader> drive, u16 drivenum, const ReadRequest& request);
+    void finishHedgedRead(HedgedRead& hedged, const RecoverFunction& recover);
 };
 
 } // end namespace sg
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "types.hpp"
+#include <vector>
+
+namespace sg
+{
+
+/// @brief Marks drive which has no data stripe in the row (it's P or Q drive there).
+const u16 NOT_DATA_DRIVE = 0xFFFF;
+
+/// @brief Position of logical offset in the array. It's computed once per read
+/// with locate() and then moved from stripe to stripe with next(), so walking
+/// over stripes needs no divisions at all.
+struct StripeLocation
+{
+    u64 row;
+    /// @brief row % rows in parity cycle, index into layout table
+    u32 cycleRow;
+    /// @brief Index of the stripe among data stripes of the row
+    u16 column;
+    u32 relativeOffset;
+};
+
+/// @brief Layout of Smart Array RAID 0, 5 and 6, computed once at construction.
+/// With parity delay parity drive changes every parityDelay rows, going from the last drive
+/// to the first one, so layout of rows repeats every drives * parityDelay rows. That's small
+/// enough to precompute order of data drives, P and Q drive for every row of the cycle.
+class StripeGeometry
+{
+public:
+    /// @param stripeSize in bytes
+    /// @param parityDrives 0 for RAID 0, 1 for RAID 5 (P), 2 for RAID 6 (P and Q)
+    /// @param size size of logical drive, it's used to find last row, which has smaller stripes
+    StripeGeometry(u32 stripeSize, u16 drives, u16 parityDrives, u16 parityDelay, u64 size, u64 physicalDriveOffset);
+
+    StripeLocation locate(u64 offset) const;
+
+    /// @brief Moves location to the beginning of the next stripe.
+    void next(StripeLocation& location) const
+    {
+        location.relativeOffset = 0;
+        if (++location.column < this->dataDrives)
+        {
+            return;
+        }
+
+        location.column = 0;
+        location.row++;
+        if (++location.cycleRow == this->cycleRows)
+        {
+            location.cycleRow = 0;
+        }
+    }
+
+    /// @brief Size of the stripe at location, stripes in the last row are smaller.
+    u32 stripeSize(const StripeLocation& location) const
+    {
+        return location.row == this->lastRow ? this->lastRowStripeSize : this->fullStripeSize;
+    }
+
+    u16 driveNumber(const StripeLocation& location) const
+    {
+        return this->dataDriveTable[location.cycleRow * this->dataDrives + location.column];
+    }
+
+    u64 driveOffset(const StripeLocation& location) const
+    {
+        return location.row * this->fullStripeSize + location.relativeOffset + this->physicalDriveOffset;
+    }
+
+    /// @brief Logical bytes in one full row, data stripes of all data drives.
+    u64 logicalRowSize() const { return this->rowSize; }
+
+    /// @brief Row of the parity cycle, to which offset on a member drive belongs.
+    u32 cycleRowOf(u64 driveOffset) const;
+
+    u16 parityDrive(u32 cycleRow) const { return this->parityTable[cycleRow]; }
+    u16 reedSolomonDrive(u32 cycleRow) const { return this->reedSolomonTable[cycleRow]; }
+
+    /// @brief Index of drive among data drives of the row or NOT_DATA_DRIVE.
+    u16 dataIndex(u32 cycleRow, u16 drivenum) const
+    {
+        return this->dataIndexTable[cycleRow * this->drives + drivenum];
+    }
+
+private:
+    u32 fullStripeSize;
+    u16 drives;
+    u16 dataDrives;
+    u32 cycleRows;
+    u64 physicalDriveOffset;
+
+    // Stripe size is almost always power of 2, then offsets are split with shift and mask.
+    // Otherwise (like RAID 0 over RAID 5 groups in RAID 50) stripeShift is 0 and plain division is used.
+    u32 stripeShift;
+    u32 stripeMask;
+
+    u64 rowSize;
+    u64 lastRow;
+    u32 lastRowStripeSize;
+
+    // cycleRows * dataDrives, drive number of every data stripe in the row
+    std::vector<u16> dataDriveTable;
+    // cycleRows * drives, inverse of the above
+    std::vector<u16> dataIndexTable;
+    std::vector<u16> parityTable;
+    std::vector<u16> reedSolomonTable;
+};
+
+} // end namespace sg
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "types.hpp"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace sg
+{
+
+/// @brief Fixed number of worker threads executing posted tasks in order.
+class ThreadPool
+{
+public:
+    ThreadPool(u32 threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void post(std::function<void()> task);
+    u32 size();
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable tasksAvailable;
+    bool stopping = false;
+
+    void workerLoop();
+};
+
+} // end namespace sg
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "async_drive_reader.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace sg
+{
+
+/// @brief Reads requests in parallel on a pool of threads with plain DriveReader::read.
+/// Works for any DriveReader, also for nested RAID readers.
+/// Calling thread reads requests too, so nested readAll calls can't deadlock
+/// even if all pool threads are busy.
+class ThreadPoolDriveReader : public AsyncDriveReader
+{
+public:
+    ThreadPoolDriveReader(u32 threads);
+    void readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted = nullptr) override;
+
+private:
+    ThreadPool pool;
+};
+
+} // end namespace sg
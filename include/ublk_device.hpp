@@ -0,0 +1,82 @@
+#pragma once
+
+#include "types.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <pthread.h>
+
+namespace sg
+{
+
+class IoUringQueue;
+
+/// @brief Reads len bytes at offset of the device into buf, returns 0 on success and -1 on failure.
+/// It's called from many queue threads at once.
+typedef std::function<int(void* buf, u32 len, u64 offset)> UblkReadCallback;
+
+struct UblkDeviceOptions
+{
+    UblkReadCallback read;
+    /// @brief Size of the device in bytes
+    u64 size;
+    /// @brief Number N of /dev/ublkbN, -1 lets the kernel pick a free one
+    int deviceId = -1;
+    /// @brief Every queue is served by its own thread
+    u16 queues = 1;
+    /// @brief Requests which can be in flight in one queue
+    u16 queueDepth = 64;
+    /// @brief Biggest request kernel sends to us, in bytes
+    u32 maxIoSize = 512 * 1024;
+};
+
+/// @brief Read only block device /dev/ublkbN backed by a read callback.
+/// Kernel passes requests to us thru io_uring commands on /dev/ublkcN and copies data
+/// straight from our buffers into bios, no socket and no request headers like with nbd.
+/// Needs ublk_drv kernel module (Linux 6.0+).
+class UblkDevice
+{
+public:
+    /// @brief Adds the device to ublk driver, it shows up only after run() starts it.
+    UblkDevice(const UblkDeviceOptions& options);
+    /// @brief Deletes the device from ublk driver.
+    ~UblkDevice();
+    UblkDevice(const UblkDevice&) = delete;
+    UblkDevice& operator=(const UblkDevice&) = delete;
+
+    /// @brief Starts the device and serves its requests until SIGINT or SIGTERM
+    /// or until the device is stopped from outside, then stops the device.
+    void run();
+
+    int deviceId();
+    std::string blockDevicePath();
+
+    /// @brief Checks if ublk driver is loaded.
+    static bool isSupported();
+
+private:
+    UblkDeviceOptions options;
+    int controlFd = -1;
+    int charFd = -1;
+    std::unique_ptr<IoUringQueue> controlQueue;
+    // ioctl encoded opcodes or the legacy ones, depends on what the kernel accepts
+    bool encodedOpcodes = true;
+
+    std::mutex mutex;
+    std::condition_variable queueReady;
+    u16 readyQueues = 0;
+    u16 runningQueues = 0;
+    std::string queueError;
+
+    int controlCommand(u32 opcode, u16 queueId, void* buf, u16 len, u64 data);
+    u32 ioOpcode(u32 opcode);
+    void openCharDevice();
+    void serveQueue(u16 queueId, pthread_t mainThread);
+    int handleRequest(u8 op, void* buf, u32 len, u64 offset);
+};
+
+} // end namespace sg
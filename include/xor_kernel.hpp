@@ -0,0 +1,63 @@
+#pragma once
+
+#include "types.hpp"
+#include <cstddef>
+#include <vector>
+
+namespace sg
+{
+
+/// @brief How many buffers recovery code collects before XORing them in one pass.
+/// More sources per pass means less passes over output buffer.
+const u32 XOR_FOLD_SOURCES = 4;
+
+/// @brief out ^= sources[0] ^ sources[1] ^ ... ^ sources[count - 1]
+/// It goes over memory once, no matter how many sources are given.
+/// Uses the widest SIMD variant supported by the CPU (SSE2, AVX2 or AVX-512),
+/// it's selected once at runtime.
+void xorInto(void* out, const void* const* sources, u32 count, size_t len);
+
+/// @brief One of XOR variants, it does the same as xorInto.
+struct XorKernel
+{
+    const char* name;
+    void (*function)(void* out, const void* const* sources, u32 count, size_t len);
+};
+
+/// @brief Scalar reference and every SIMD variant supported by the CPU, from the narrowest one.
+/// The last one is used by xorInto. It's here for xor-bench.
+std::vector<XorKernel> xorKernels();
+
+/// @brief Name of the XOR variant selected for this CPU.
+const char* xorKernelName();
+
+/// @brief Checks whether buffer has only zeros, like XOR of stripes which should be equal.
+bool isZero(const void* buf, size_t len);
+
+/// @brief XORs buffers into output as they come from the drives, XOR_FOLD_SOURCES at once.
+/// Output itself is expected to be read from one of the drives too (so it doesn't have to be zeroed),
+/// so until outputRead is called buffers are folded into the first of them instead.
+/// That's why sources can be overwritten.
+class XorAccumulator
+{
+public:
+    XorAccumulator(void* out, size_t len);
+
+    /// @brief Output buffer holds data of one of the sources now.
+    void outputRead();
+    void add(void* source);
+
+    /// @brief XORs remaining sources into output, it must be read already.
+    void finish();
+
+private:
+    void* out;
+    size_t len;
+    bool outputReady = false;
+    void* sources[XOR_FOLD_SOURCES];
+    u32 count = 0;
+
+    void fold();
+};
+
+} // end namespace sg
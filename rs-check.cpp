@@ -0,0 +1,168 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include "smart_array_raid_6_reader.hpp"
+#include "galois_field.hpp"
+#include "types.hpp"
+
+using namespace sg;
+
+// Checks RAID 6 decoding against stripes saved from real P420 arrays in raid-6-problem directory.
+// Every Galois field variant has to compute their Q, and the reader has to recover every
+// pair of missing drives: two data drives, data drive and parity, data drive and Reed Solomon.
+// Usage: rs-check [path to raid-6-problem, default ./raid-6-problem]
+// Exits with 0 when everything matches, with 1 otherwise.
+
+static const u32 SAMPLE_STRIPE_SIZE = 256 * 1024;
+static const u64 METADATA_AREA_SIZE = 32 * 1024 * 1024;
+
+/// @brief Member drive with one stripe, followed by empty metadata area.
+class SampleDriveReader : public DriveReader
+{
+public:
+    SampleDriveReader(const std::vector<u8>& stripe, const std::string& name)
+        : stripe(stripe)
+    {
+        this->driveName = name;
+    }
+
+    int read(void* buf, u32 len, u64 offset) override
+    {
+        char* out = static_cast<char*>(buf);
+        memset(out, 0, len);
+        if (offset < this->stripe.size())
+        {
+            memcpy(out, this->stripe.data() + offset, std::min<u64>(len, this->stripe.size() - offset));
+        }
+        return 0;
+    }
+
+    u64 driveSize() override
+    {
+        return SAMPLE_STRIPE_SIZE + METADATA_AREA_SIZE;
+    }
+
+private:
+    const std::vector<u8>& stripe;
+};
+
+static std::vector<u8> loadStripe(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<u8> stripe(SAMPLE_STRIPE_SIZE);
+    if (!file.read(reinterpret_cast<char*>(stripe.data()), stripe.size()))
+    {
+        throw std::runtime_error("Reading sample " + path + " has failed.");
+    }
+    return stripe;
+}
+
+static std::string driveLabel(u16 drive, u16 dataDrives)
+{
+    if (drive < dataDrives)
+    {
+        return "d" + std::to_string(drive + 1);
+    }
+    return drive == dataDrives ? "parity" : "rs";
+}
+
+/// @brief Returns number of failed checks.
+static int checkSample(const std::string& dir, u16 dataDrives)
+{
+    int failures = 0;
+    std::vector<std::vector<u8>> stripes;
+    for (u16 i = 0; i < dataDrives; i++)
+    {
+        stripes.push_back(loadStripe(dir + "/d" + std::to_string(i + 1) + ".bin"));
+    }
+    stripes.push_back(loadStripe(dir + "/parity.bin"));
+    stripes.push_back(loadStripe(dir + "/rs.bin"));
+
+    const std::vector<u8>& reedSolomon = stripes.back();
+    for (auto& kernel : gfKernels())
+    {
+        std::vector<u8> q(SAMPLE_STRIPE_SIZE, 0);
+        for (u16 i = 0; i < dataDrives; i++)
+        {
+            kernel.function(q.data(), stripes[i].data(), P420_REED_SOLOMON_COEFFICIENTS[i], q.size(), true);
+        }
+
+        bool correct = q == reedSolomon;
+        failures += !correct;
+        std::cout << dir << ": Q computed with " << kernel.name << (correct ? " matches" : " DOESN'T MATCH") << std::endl;
+    }
+
+    // In the first row of the array drives go as data drives, parity, Reed Solomon
+    std::vector<u8> expected;
+    for (u16 i = 0; i < dataDrives; i++)
+    {
+        expected.insert(expected.end(), stripes[i].begin(), stripes[i].end());
+    }
+
+    u16 drives = dataDrives + 2;
+    for (u16 missing1 = 0; missing1 < dataDrives; missing1++)
+    {
+        for (u16 missing2 = missing1 + 1; missing2 < drives; missing2++)
+        {
+            SmartArrayRaid6ReaderOptions options {
+                .stripeSize = SAMPLE_STRIPE_SIZE / 1024,
+                .parityDelay = 1,
+                .size = expected.size()
+            };
+            for (u16 i = 0; i < drives; i++)
+            {
+                bool missing = i == missing1 || i == missing2;
+                options.driveReaders.push_back(missing ? nullptr : std::make_shared<SampleDriveReader>(stripes[i], driveLabel(i, dataDrives)));
+            }
+
+            std::vector<u8> recovered(expected.size());
+            bool correct;
+            try
+            {
+                SmartArrayRaid6Reader reader(options);
+                reader.read(recovered.data(), recovered.size(), 0);
+                correct = recovered == expected;
+            }
+            catch (std::exception& ex)
+            {
+                std::cout << ex.what() << std::endl;
+                correct = false;
+            }
+
+            failures += !correct;
+            std::cout << dir << ": without " << driveLabel(missing1, dataDrives) << " and " << driveLabel(missing2, dataDrives)
+                      << (correct ? " recovered" : " NOT RECOVERED") << std::endl;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    std::string samples = argc > 1 ? argv[1] : "raid-6-problem";
+    int failures = 0;
+
+    try
+    {
+        failures += checkSample(samples + "/4-drives", 2);
+        failures += checkSample(samples + "/5-drives", 3);
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    if (failures > 0)
+    {
+        std::cout << failures << " checks have failed." << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "aligned_buffer_pool.hpp"
+#include <stdlib.h>
+#include <new>
+
+namespace sg
+{
+
+AlignedBufferPool::Buffer::Buffer(AlignedBufferPool& pool, char* data)
+    : pool(pool), ptr(data)
+{
+}
+
+AlignedBufferPool::Buffer::~Buffer()
+{
+    this->pool.release(this->ptr);
+}
+
+char* AlignedBufferPool::Buffer::data()
+{
+    return this->ptr;
+}
+
+size_t AlignedBufferPool::Buffer::size()
+{
+    return this->pool.bufferSize();
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t bufferSize, size_t alignment)
+    : size(bufferSize), alignment(alignment)
+{
+}
+
+AlignedBufferPool::~AlignedBufferPool()
+{
+    for (char* buffer : this->freeBuffers)
+    {
+        free(buffer);
+    }
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->freeBuffers.empty())
+        {
+            char* buffer = this->freeBuffers.back();
+            this->freeBuffers.pop_back();
+            return Buffer(*this, buffer);
+        }
+    }
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, this->alignment, this->size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+
+    return Buffer(*this, static_cast<char*>(buffer));
+}
+
+size_t AlignedBufferPool::bufferSize()
+{
+    return this->size;
+}
+
+void AlignedBufferPool::release(char* data)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->freeBuffers.push_back(data);
+}
+
+} // end namespace sg
@@ -0,0 +1,437 @@
+#include "array_options.hpp"
+#include "smart_array_raid_0_reader.hpp"
+#include "smart_array_raid_1_reader.hpp"
+#include "smart_array_raid_5_reader.hpp"
+#include "smart_array_raid_6_reader.hpp"
+#include "smart_array_raid_10_reader.hpp"
+#include "smart_array_raid_50_reader.hpp"
+#include "smart_array_raid_60_reader.hpp"
+#include "async_drive_reader.hpp"
+#include "io_uring_drive_reader.hpp"
+#include "thread_pool_drive_reader.hpp"
+#include "caching_drive_reader.hpp"
+#include "ddrescue_image_reader.hpp"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <limits.h>
+
+namespace sg
+{
+
+// Keys for options that have only long version, programs using arrayArgp start theirs from 1100
+enum ArrayLongOnlyOption
+{
+    OPT_DIRECT_IO = 1000,
+    OPT_IO_ENGINE,
+    OPT_IO_THREADS,
+    OPT_RS_COEFFICIENTS,
+    OPT_CACHE_SIZE,
+    OPT_READAHEAD,
+    OPT_BAD_ROWS,
+    OPT_MAPFILE,
+    OPT_HEDGE
+};
+
+static argp_option arrayOptionList[] = {
+    { "stripe-size", 's', "256", 0, "Stripe size in KiB. Default: 256", 0 },
+    { "parity-delay", 'p', "16", 0, "Parity delay, P420 Controllers use parity delay for their RAID 5, read more: https://www.freeraidrecovery.com/library/delayed-parity.aspx. Default: 16", 0 },
+    { "delay", 'p', 0, OPTION_ALIAS, 0, 0 },
+    { "raid", 'r', "<level>", 0, "Raid level, required!", 0 },
+    { "parity-groups", 'g', "2", 0, "Parity groups in RAID 50 and 60", 0 },
+    { "size", 'S', "0", 0, "Size of logical drives, 0 is maximum possible. Default: 0" },
+    { "offset", 'O', "0", 0, "Offset on each physical drive, Default: 0" },
+    { "direct-io", OPT_DIRECT_IO, 0, 0, "Read drives with O_DIRECT, bypassing page cache. Useful for big arrays, so their data won't evict everything else from memory.", 0 },
+    { "io-engine", OPT_IO_ENGINE, "sync", 0, "How segments from different drives are read. sync - one after another, io_uring - all at once with io_uring, threads - all at once on a thread pool. Default: sync", 0 },
+    { "io-threads", OPT_IO_THREADS, "N", 0, "Number of threads for --io-engine=threads. Default: number of drives", 0 },
+    { "rs-coefficients", OPT_RS_COEFFICIENTS, "101,186,188", 0, "Reed Solomon coefficients of data drives in RAID 6 and 60, comma separated. Needed to recover 2 missing drives in arrays with more than 3 data drives. Default: 101,186,188", 0 },
+    { "cache-size", OPT_CACHE_SIZE, "MiB", 0, "Keep that many MiB of recently read stripes in memory, so data read over and over (like filesystem metadata) isn't read and reconstructed again. Hits and misses are printed on exit. Default: 0 (disabled)", 0 },
+    { "readahead", OPT_READAHEAD, "ROWS", 0, "Read that many rows of stripes ahead of sequential reads (like dd or rsync) in background, up to 8 streams at once. Hits and misses are printed on exit. Default: 0 (disabled)", 0 },
+    { "bad-rows", OPT_BAD_ROWS, "FILE", 0, "Bad row list saved by hewlett-verify (RAID 5 and 6). Data reconstructed from rows with mismatching parity is reported, as it may be wrong.", 0 },
+    { "mapfile", OPT_MAPFILE, "N:FILE", 0, "N-th drive (counting from 1) is an image made by GNU ddrescue and FILE is its mapfile. Areas ddrescue didn't rescue are reconstructed from the other drives in RAID 5 and 6, instead of being read as zeros. Can be given for many drives.", 0 },
+    { "hedge", OPT_HEDGE, 0, 0, "Track read latency of drives (RAID 5 and 6). When a drive is much slower than the others its reads are raced with reconstruction from the other drives, and really slow drive is treated as missing until it gets better. Latency is printed on exit.", 0 },
+    {0}
+};
+
+u16 argToU16(std::string arg, std::string argName)
+{
+    try 
+    {
+        unsigned num = std::stoul(arg);
+        if (num > USHRT_MAX)
+        {
+            throw std::out_of_range("Argument exceeds range");
+        }
+        return num;
+    }
+    catch(std::invalid_argument const& ex)
+    {
+        throw std::invalid_argument("Argument " + argName + " (value:" + arg + ") is invalid. It has to be unsigned 16 bit integer.");
+    }
+    catch(std::out_of_range const& ex)
+    {
+        throw std::out_of_range("Argument " + argName + " (value:" + arg + ") is too large!. It has to be unsigned 16 bit integer.");
+    }
+}
+
+u32 argToU32(std::string arg, std::string argName)
+{
+    try 
+    {
+        return std::stoul(arg);
+    }
+    catch(std::invalid_argument const& ex)
+    {
+        throw std::invalid_argument("Argument " + argName + " (value:" + arg + ") is invalid. It has to be unsigned 32 bit integer.");
+    }
+    catch(std::out_of_range const& ex)
+    {
+        throw std::out_of_range("Argument " + argName + " (value:" + arg + ") is too large!. It has to be unsigned 32 bit integer.");
+    }
+}
+
+u64 argToU64(std::string arg, std::string argName)
+{
+    try 
+    {
+        return std::stoull(arg);
+    }
+    catch(std::invalid_argument const& ex)
+    {
+        throw std::invalid_argument("Argument " + argName + " (value:" + arg + ") is invalid. It has to be unsigned 64 bit integer.");
+    }
+    catch(std::out_of_range const& ex)
+    {
+        throw std::out_of_range("Argument " + argName + " (value:" + arg + ") is too large!. It has to be unsigned 64 bit integer.");
+    }
+}
+
+std::vector<u8> argToU8List(std::string arg, std::string argName)
+{
+    std::vector<u8> list;
+    std::stringstream ss(arg);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+    {
+        u16 num = argToU16(item, argName);
+        if (num > UCHAR_MAX)
+        {
+            throw std::out_of_range("Argument " + argName + " (value:" + item + ") is too large!. It has to be unsigned 8 bit integer.");
+        }
+        list.push_back(num);
+    }
+
+    return list;
+}
+
+static error_t parseArrayOpt(int key, char *arg, argp_state *state)
+{
+    ArrayOptions* options = reinterpret_cast<ArrayOptions*>(state->input);
+    std::string argStr;
+
+    switch (key)
+    {
+    case 's':
+        options->stripeSize = argToU32(arg, "stripe-size");
+        break;
+    case 'p':
+        options->parityDelay = argToU16(arg, "parity-delay");
+        break;
+    case 'r':
+        options->raidLevel = argToU16(arg, "raid");
+        break;
+    case 'g':
+        options->parityGroups = argToU16(arg, "parity-groups");
+        break;
+    case 'S':
+        options->size = argToU64(arg, "size");
+        break;
+    case 'O':
+        options->offset = argToU64(arg, "offset");
+        break;
+    case OPT_DIRECT_IO:
+        options->directIo = true;
+        break;
+    case OPT_IO_ENGINE:
+        options->ioEngine = arg;
+        break;
+    case OPT_IO_THREADS:
+        options->ioThreads = argToU16(arg, "io-threads");
+        break;
+    case OPT_RS_COEFFICIENTS:
+        options->reedSolomonCoefficients = argToU8List(arg, "rs-coefficients");
+        break;
+    case OPT_CACHE_SIZE:
+        options->cacheSize = argToU64(arg, "cache-size");
+        break;
+    case OPT_READAHEAD:
+        options->readahead = argToU32(arg, "readahead");
+        break;
+    case OPT_BAD_ROWS:
+        options->badRowsPath = arg;
+        break;
+    case OPT_HEDGE:
+        options->hedge = true;
+        break;
+    case OPT_MAPFILE:
+        argStr = arg;
+        if (argStr.find(':') == std::string::npos)
+        {
+            throw std::invalid_argument("Argument mapfile (value:" + argStr + ") has to look like N:FILE.");
+        }
+        options->mapfiles[argToU16(argStr.substr(0, argStr.find(':')), "mapfile")] = argStr.substr(argStr.find(':') + 1);
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num > 256)
+        {
+            throw std::invalid_argument("Too many arguments.");
+        }
+        argStr = arg;
+        if (argStr == "X")
+        {
+            argStr.clear();
+        }
+
+        options->drives.push_back(argStr);
+        break;
+    case ARGP_KEY_END:
+        if (state->arg_num < 1)
+        {
+            std::cerr << "Not enough arguments." << std::endl;
+            argp_usage(state);
+        }
+        break;
+
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+const argp arrayArgp = {
+    .options = arrayOptionList,
+    .parser = parseArrayOpt,
+    .args_doc = "DRIVE1 DRIVE2 ...DRIVEN"
+};
+
+static void drivesPathVectorToDeviceReaderVector(
+    const ArrayOptions& opts,
+    std::vector<std::shared_ptr<DriveReader>>& out)
+{
+    for (auto& [position, mapfile] : opts.mapfiles)
+    {
+        if (position == 0 || position > opts.drives.size() || opts.drives[position - 1].empty())
+        {
+            throw std::invalid_argument("Mapfile " + mapfile + " is given for drive " + std::to_string(position) + ", which isn't in the array.");
+        }
+    }
+
+    for (size_t i = 0; i < opts.drives.size(); i++)
+    {
+        auto& path = opts.drives[i];
+        auto mapfile = opts.mapfiles.find(i + 1);
+
+        if (!path.empty() && mapfile != opts.mapfiles.end())
+        {
+            out.push_back(std::make_shared<DdrescueImageReader>(path, mapfile->second, opts.directIo));
+        }
+        else if (!path.empty())
+        {
+            out.push_back(std::make_shared<BlockDeviceReader>(path, opts.directIo));
+        }
+        else
+        {
+            // Reader should handle this
+            out.push_back(nullptr);
+        }
+    }
+}
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid0(const ArrayOptions &opts)
+{
+    SmartArrayRaid0ReaderOptions readerOpts {
+        .stripeSize = opts.stripeSize,
+        .size = opts.size,
+        .offset = opts.offset
+    };
+
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+    
+    return std::make_unique<SmartArrayRaid0Reader>(readerOpts);
+}
+
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid1(const ArrayOptions &opts)
+{
+    SmartArrayRaid1ReaderOptions readerOpts {
+        .size = opts.size,
+        .offset = opts.offset
+    };
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+    return std::make_unique<SmartArrayRaid1Reader>(readerOpts);
+}
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid5(const ArrayOptions &opts)
+{
+    SmartArrayRaid5ReaderOptions readerOpts {
+        .stripeSize = opts.stripeSize,
+        .parityDelay = opts.parityDelay,
+        .size = opts.size,
+        .offset = opts.offset
+    };
+
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+
+    return std::make_unique<SmartArrayRaid5Reader>(readerOpts);
+}
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid6(const ArrayOptions &opts)
+{
+    SmartArrayRaid6ReaderOptions readerOpts {
+        .stripeSize = opts.stripeSize,
+        .parityDelay = opts.parityDelay,
+        .reedSolomonCoefficients = opts.reedSolomonCoefficients,
+        .size = opts.size,
+        .offset = opts.offset
+    };
+
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+
+    return std::make_unique<SmartArrayRaid6Reader>(readerOpts);
+}
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid10(const ArrayOptions &opts)
+{
+    SmartArrayRaid10ReaderOptions readerOpts {
+        .stripeSize = opts.stripeSize,
+        .size = opts.size,
+        .offset = opts.offset
+    };
+
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+
+    return std::make_unique<SmartArrayRaid10Reader>(readerOpts);
+}
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid50(const ArrayOptions &opts)
+{
+    SmartArrayRaid50ReaderOptions readerOpts {
+        .stripeSize = opts.stripeSize,
+        .parityDelay = opts.parityDelay,
+        .parityGroups = opts.parityGroups,
+        .size = opts.size,
+        .offset = opts.offset
+    };
+
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+
+    return std::make_unique<SmartArrayRaid50Reader>(readerOpts);
+}
+
+static std::unique_ptr<SmartArrayReaderBase> initForRaid60(const ArrayOptions &opts)
+{
+    SmartArrayRaid60ReaderOptions readerOpts {
+        .stripeSize = opts.stripeSize,
+        .parityDelay = opts.parityDelay,
+        .parityGroups = opts.parityGroups,
+        .reedSolomonCoefficients = opts.reedSolomonCoefficients,
+        .size = opts.size,
+        .offset = opts.offset
+    };
+
+    drivesPathVectorToDeviceReaderVector(opts, readerOpts.driveReaders);
+
+    return std::make_unique<SmartArrayRaid60Reader>(readerOpts);
+}
+
+std::unique_ptr<SmartArrayReaderBase> openSmartArray(const ArrayOptions& opts)
+{
+    if (opts.ioEngine == "io_uring")
+    {
+        if (!IoUringDriveReader::isSupported())
+        {
+            throw std::invalid_argument("io_uring is not supported by your kernel, it needs Linux 5.6 or newer.");
+        }
+        setDefaultAsyncReader(std::make_shared<IoUringDriveReader>());
+    }
+    else if (opts.ioEngine == "threads")
+    {
+        u16 threads = opts.ioThreads > 0 ? opts.ioThreads : opts.drives.size();
+        setDefaultAsyncReader(std::make_shared<ThreadPoolDriveReader>(threads));
+    }
+    else if (opts.ioEngine != "sync")
+    {
+        throw std::invalid_argument("Unknown io engine " + opts.ioEngine + ".");
+    }
+
+    std::unique_ptr<SmartArrayReaderBase> reader;
+    switch (opts.raidLevel)
+    {
+        case 0:
+            reader = initForRaid0(opts);
+            break;
+        case 1:
+            reader = initForRaid1(opts);
+            break;
+        case 5:
+            reader = initForRaid5(opts);
+            break;
+        case 6:
+            reader = initForRaid6(opts);
+            break;
+        case 10:
+            reader = initForRaid10(opts);
+            break;
+        case 50:
+            reader = initForRaid50(opts);
+            break;
+        case 60:
+            reader = initForRaid60(opts);
+            break;
+        case NO_RAID_LEVEL:
+            throw std::invalid_argument("No RAID level was provided.");
+        default:
+            throw std::invalid_argument("RAID " + std::to_string(opts.raidLevel) + " is not supported.");
+    }
+
+    if (opts.readahead > 0)
+    {
+        reader->enableReadahead(opts.readahead);
+    }
+
+    if (!opts.badRowsPath.empty())
+    {
+        if (opts.raidLevel != 5 && opts.raidLevel != 6)
+        {
+            throw std::invalid_argument("Bad row list can be used only with RAID 5 and 6.");
+        }
+        reader->setBadRows(std::make_shared<BadRowList>(BadRowList::load(opts.badRowsPath)));
+    }
+
+    if (opts.hedge)
+    {
+        if (opts.raidLevel != 5 && opts.raidLevel != 6)
+        {
+            throw std::invalid_argument("Reads can be hedged only with RAID 5 and 6.");
+        }
+        reader->enableHedging();
+    }
+
+    return reader;
+}
+
+std::unique_ptr<DriveReader> openArray(const ArrayOptions& opts)
+{
+    std::unique_ptr<DriveReader> reader = openSmartArray(opts);
+    if (opts.cacheSize == 0)
+    {
+        return reader;
+    }
+
+    // Cache blocks are stripes, so one miss reconstructs exactly one stripe of missing drive
+    return std::make_unique<CachingDriveReader>(std::move(reader), opts.stripeSize * 1024, opts.cacheSize * 1024 * 1024);
+}
+
+} // end namespace sg
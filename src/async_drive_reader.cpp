@@ -0,0 +1,43 @@
+#include "async_drive_reader.hpp"
+
+namespace sg
+{
+
+void readRequest(ReadRequest& request)
+{
+    if (request.iovcnt > 0)
+    {
+        request.drive->readv(request.iov, request.iovcnt, request.offset);
+    }
+    else
+    {
+        request.drive->read(request.buf, request.len, request.offset);
+    }
+}
+
+void SequentialDriveReader::readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted)
+{
+    for (auto& request : requests)
+    {
+        readRequest(request);
+
+        if (onCompleted)
+        {
+            onCompleted(request);
+        }
+    }
+}
+
+static std::shared_ptr<AsyncDriveReader> defaultAsyncReader = std::make_shared<SequentialDriveReader>();
+
+void setDefaultAsyncReader(std::shared_ptr<AsyncDriveReader> reader)
+{
+    defaultAsyncReader = reader;
+}
+
+std::shared_ptr<AsyncDriveReader> getDefaultAsyncReader()
+{
+    return defaultAsyncReader;
+}
+
+} // end namespace sg
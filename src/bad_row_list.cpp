@@ -0,0 +1,114 @@
+#include "bad_row_list.hpp"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace sg
+{
+
+static const char* BAD_ROW_LIST_HEADER = "# hewlett-verify bad rows";
+
+void BadRowList::add(const BadRowRange& range)
+{
+    if (!this->badRanges.empty())
+    {
+        BadRowRange& last = this->badRanges.back();
+        if (last.lastRow + 1 == range.firstRow && last.driveEnd == range.driveOffset &&
+            last.parityMismatch == range.parityMismatch && last.reedSolomonMismatch == range.reedSolomonMismatch)
+        {
+            last.lastRow = range.lastRow;
+            last.driveEnd = range.driveEnd;
+            return;
+        }
+    }
+
+    this->badRanges.push_back(range);
+}
+
+bool BadRowList::contains(u64 row) const
+{
+    // First range ending at or after the row
+    auto it = std::lower_bound(this->badRanges.begin(), this->badRanges.end(), row, [](const BadRowRange& range, u64 row) {
+        return range.lastRow < row;
+    });
+
+    return it != this->badRanges.end() && it->firstRow <= row;
+}
+
+bool BadRowList::empty() const
+{
+    return this->badRanges.empty();
+}
+
+u64 BadRowList::rowCount() const
+{
+    u64 count = 0;
+    for (auto& range : this->badRanges)
+    {
+        count += range.lastRow - range.firstRow + 1;
+    }
+    return count;
+}
+
+const std::vector<BadRowRange>& BadRowList::ranges() const
+{
+    return this->badRanges;
+}
+
+void BadRowList::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    file << BAD_ROW_LIST_HEADER << "\n"
+         << "# first-row last-row drive-offset drive-end mismatch\n";
+
+    for (auto& range : this->badRanges)
+    {
+        file << range.firstRow << " " << range.lastRow << " " << range.driveOffset << " " << range.driveEnd << " "
+             << (range.parityMismatch ? "P" : "") << (range.reedSolomonMismatch ? "Q" : "") << "\n";
+    }
+
+    file.flush();
+    if (!file)
+    {
+        throw std::runtime_error("Writing bad row list " + path + " has failed.");
+    }
+}
+
+BadRowList BadRowList::load(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    if (!file || !std::getline(file, line) || line != BAD_ROW_LIST_HEADER)
+    {
+        throw std::invalid_argument("File " + path + " is not a bad row list saved by hewlett-verify.");
+    }
+
+    BadRowList list;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        BadRowRange range;
+        std::string mismatch;
+        fields >> range.firstRow >> range.lastRow >> range.driveOffset >> range.driveEnd >> mismatch;
+
+        if (!fields || range.lastRow < range.firstRow ||
+            (!list.badRanges.empty() && range.firstRow <= list.badRanges.back().lastRow))
+        {
+            throw std::invalid_argument("Bad row list " + path + " has invalid line: " + line);
+        }
+
+        range.parityMismatch = mismatch.find('P') != std::string::npos;
+        range.reedSolomonMismatch = mismatch.find('Q') != std::string::npos;
+        list.badRanges.push_back(range);
+    }
+
+    return list;
+}
+
+} // end namespace sg
@@ -0,0 +1,96 @@
+#include "bad_sector_map.hpp"
+#include <mutex>
+#include <algorithm>
+
+namespace sg
+{
+
+void BadSectorMap::add(u16 drivenum, u64 offset, u64 len)
+{
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    if (this->ranges.size() <= drivenum)
+    {
+        this->ranges.resize(drivenum + 1);
+    }
+
+    auto& driveRanges = this->ranges[drivenum];
+    u64 start = offset;
+    u64 end = offset + len;
+
+    // Ranges starting before the end of new one and ending at or after its start are joined with it
+    auto it = driveRanges.upper_bound(start);
+    if (it != driveRanges.begin() && std::prev(it)->second >= start)
+    {
+        it--;
+    }
+    while (it != driveRanges.end() && it->first <= end)
+    {
+        start = std::min(start, it->first);
+        end = std::max(end, it->second);
+        it = driveRanges.erase(it);
+    }
+
+    driveRanges[start] = end;
+    this->hasRanges = true;
+}
+
+bool BadSectorMap::overlaps(u16 drivenum, u64 offset, u32 len)
+{
+    bool found = false;
+    this->forEachPiece(drivenum, offset, len, [&found](u64, u32, bool bad) {
+        found = found || bad;
+    });
+    return found;
+}
+
+std::vector<std::pair<u64, u64>> BadSectorMap::badPieces(u16 drivenum, u64 offset, u32 len)
+{
+    std::vector<std::pair<u64, u64>> bad;
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    if (drivenum >= this->ranges.size())
+    {
+        return bad;
+    }
+
+    auto& driveRanges = this->ranges[drivenum];
+    auto it = driveRanges.upper_bound(offset);
+    if (it != driveRanges.begin())
+    {
+        it--;
+    }
+    for (; it != driveRanges.end() && it->first < offset + len; it++)
+    {
+        if (it->second > offset)
+        {
+            bad.push_back({ std::max(it->first, offset), std::min(it->second, offset + len) });
+        }
+    }
+
+    return bad;
+}
+
+bool BadSectorMap::empty()
+{
+    return !this->hasRanges;
+}
+
+void BadSectorMap::printStats(std::ostream& out)
+{
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->ranges.size(); i++)
+    {
+        if (this->ranges[i].empty())
+        {
+            continue;
+        }
+
+        u64 bytes = 0;
+        for (auto& [start, end] : this->ranges[i])
+        {
+            bytes += end - start;
+        }
+        out << "Unreadable sectors of drive " << i + 1 << ": " << bytes << " bytes in " << this->ranges[i].size() << " ranges" << std::endl;
+    }
+}
+
+} // end namespace sg
@@ -0,0 +1,207 @@
+#include "caching_drive_reader.hpp"
+#include "scratch_arena.hpp"
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace sg
+{
+
+CachingDriveReader::CachingDriveReader(std::shared_ptr<DriveReader> reader, u32 blockSize, u64 capacity, u32 shards)
+{
+    if (blockSize == 0 || shards == 0)
+    {
+        throw std::invalid_argument("Cache block size and number of shards can't be 0.");
+    }
+
+    this->reader = reader;
+    this->blockSize = blockSize;
+    this->size = reader->driveSize();
+    this->driveName = reader->name();
+
+    // Every shard holds at least one block, so tiny cache still works
+    this->blocksPerShard = std::max<u64>(capacity / blockSize / shards, 1);
+    for (u32 i = 0; i < shards; i++)
+    {
+        this->shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+int CachingDriveReader::read(void* buf, u32 len, u64 offset)
+{
+    if (offset + len > this->size)
+    {
+        std::cerr << this->name() << ": Tried to read from offset exceeding drive size. Skipping." << std::endl;
+        return -1;
+    }
+
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    char* out = static_cast<char*>(buf);
+    u64 end = offset + len;
+    u64 lastBlock = (end - 1) / this->blockSize;
+
+    // Part of block which lies inside of requested range
+    auto partOf = [&](u64 block, u32& from, u32& partLen) {
+        u64 blockStart = block * this->blockSize;
+        u64 start = std::max(offset, blockStart);
+        from = start - blockStart;
+        partLen = std::min<u64>(end, blockStart + this->blockSize) - start;
+        return out + (start - offset);
+    };
+
+    u64 block = offset / this->blockSize;
+    while (block <= lastBlock)
+    {
+        u32 from, partLen;
+        char* dst = partOf(block, from, partLen);
+        if (this->lookup(block, from, partLen, dst))
+        {
+            this->hitCount++;
+            block++;
+            continue;
+        }
+
+        // Missing blocks next to each other are read with one request
+        u64 runEnd = block + 1;
+        while (runEnd <= lastBlock && !this->contains(runEnd))
+        {
+            runEnd++;
+        }
+
+        u64 runStart = block * this->blockSize;
+        u64 runLen = std::min(runEnd * this->blockSize, this->size) - runStart;
+
+        ScratchArena::Frame frame;
+        char* data = frame.allocate(runLen);
+        this->missCount += runEnd - block;
+
+        // Failed read leaves garbage in data, it mustn't get into the cache
+        int result = this->reader->read(data, static_cast<u32>(runLen), runStart);
+        if (result != 0)
+        {
+            return result;
+        }
+
+        for (; block < runEnd; block++)
+        {
+            const char* blockData = data + (block * this->blockSize - runStart);
+            this->insert(block, blockData);
+            dst = partOf(block, from, partLen);
+            memcpy(dst, blockData + from, partLen);
+        }
+    }
+
+    return 0;
+}
+
+bool CachingDriveReader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    return this->reader->mapExtents(len, offset, extents);
+}
+
+u64 CachingDriveReader::driveSize()
+{
+    return this->size;
+}
+
+std::string CachingDriveReader::name()
+{
+    return this->reader->name();
+}
+
+void CachingDriveReader::printStats(std::ostream& out)
+{
+    u64 hits = this->hits();
+    u64 misses = this->misses();
+    u64 total = hits + misses;
+    out << "Cache: " << hits << " hits, " << misses << " misses";
+    if (total > 0)
+    {
+        out << " (" << hits * 100 / total << "% hit rate)";
+    }
+    out << std::endl;
+
+    this->reader->printStats(out);
+}
+
+u64 CachingDriveReader::hits()
+{
+    return this->hitCount;
+}
+
+u64 CachingDriveReader::misses()
+{
+    return this->missCount;
+}
+
+CachingDriveReader::Shard& CachingDriveReader::shardOf(u64 block)
+{
+    // Neighbouring blocks go to different shards, so sequential reads don't fight for one lock
+    return *this->shards[block % this->shards.size()];
+}
+
+bool CachingDriveReader::lookup(u64 block, u32 from, u32 len, char* out)
+{
+    Shard& shard = this->shardOf(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(block);
+    if (it == shard.index.end())
+    {
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    memcpy(out, it->second->data.get() + from, len);
+    return true;
+}
+
+bool CachingDriveReader::contains(u64 block)
+{
+    Shard& shard = this->shardOf(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.index.contains(block);
+}
+
+void CachingDriveReader::insert(u64 block, const char* data)
+{
+    u32 len = this->blockLength(block);
+    Shard& shard = this->shardOf(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Other thread could have read it at the same time
+    auto it = shard.index.find(block);
+    if (it != shard.index.end())
+    {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    // When shard is full the least recently used entry is reused, with its buffer
+    if (shard.index.size() >= this->blocksPerShard)
+    {
+        shard.index.erase(shard.lru.back().block);
+        shard.lru.splice(shard.lru.begin(), shard.lru, std::prev(shard.lru.end()));
+    }
+    else
+    {
+        shard.lru.push_front({ 0, std::unique_ptr<char[]>(new char[this->blockSize]) });
+    }
+
+    Entry& entry = shard.lru.front();
+    entry.block = block;
+    memcpy(entry.data.get(), data, len);
+    shard.index[block] = shard.lru.begin();
+}
+
+u32 CachingDriveReader::blockLength(u64 block)
+{
+    return std::min<u64>(this->blockSize, this->size - block * this->blockSize);
+}
+
+} // end namespace sg
@@ -0,0 +1,177 @@
+#include "ddrescue_image_reader.hpp"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace sg
+{
+
+DdrescueImageReader::DdrescueImageReader(std::string path, std::string mapfilePath, bool directIo)
+{
+    this->driveName = path;
+    this->image = std::make_unique<BlockDeviceReader>(path, directIo);
+    this->loadMapfile(mapfilePath);
+
+    u64 holeBytes = 0;
+    for (auto& [start, end] : this->holes)
+    {
+        holeBytes += end - start;
+    }
+    if (holeBytes > 0)
+    {
+        std::cerr << path << ": " << holeBytes << " bytes in " << this->holes.size()
+                  << " areas weren't rescued by ddrescue, they will be reconstructed from the other drives." << std::endl;
+    }
+}
+
+int DdrescueImageReader::read(void* buf, u32 len, u64 offset)
+{
+    this->checkRescued(offset, len);
+    return this->image->read(buf, len, offset);
+}
+
+int DdrescueImageReader::readv(const iovec* iov, int iovcnt, u64 offset)
+{
+    u64 len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].iov_len;
+    }
+
+    this->checkRescued(offset, len);
+    return this->image->readv(iov, iovcnt, offset);
+}
+
+int DdrescueImageReader::fileDescriptorFor(const void* buf, u32 len, u64 offset)
+{
+    // Async readers would read holes straight from the image, they have to go thru read()
+    return this->isRescued(offset, len) ? this->image->fileDescriptorFor(buf, len, offset) : -1;
+}
+
+bool DdrescueImageReader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    return this->isRescued(offset, len) && this->image->mapExtents(len, offset, extents);
+}
+
+u64 DdrescueImageReader::driveSize()
+{
+    return this->image->driveSize();
+}
+
+std::vector<std::pair<u64, u64>> DdrescueImageReader::unreadableRanges()
+{
+    return std::vector<std::pair<u64, u64>>(this->holes.begin(), this->holes.end());
+}
+
+void DdrescueImageReader::loadMapfile(const std::string& mapfilePath)
+{
+    std::ifstream file(mapfilePath);
+    if (!file)
+    {
+        throw std::invalid_argument("Could not open ddrescue mapfile " + mapfilePath);
+    }
+
+    // First line which isn't a comment is current position and status of ddrescue,
+    // after it there's one line for every block: position, size and status.
+    // Only blocks with status + were rescued, numbers are usually in hex.
+    std::string line;
+    bool statusLine = true;
+    u64 covered = 0;
+
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        if (statusLine)
+        {
+            statusLine = false;
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string posStr, sizeStr, status;
+        fields >> posStr >> sizeStr >> status;
+
+        u64 pos, size;
+        try
+        {
+            pos = std::stoull(posStr, nullptr, 0);
+            size = std::stoull(sizeStr, nullptr, 0);
+        }
+        catch (std::exception& ex)
+        {
+            throw std::invalid_argument("ddrescue mapfile " + mapfilePath + " has invalid line: " + line);
+        }
+        if (status.size() != 1 || pos < covered)
+        {
+            throw std::invalid_argument("ddrescue mapfile " + mapfilePath + " has invalid line: " + line);
+        }
+
+        // Areas missing from mapfile weren't read either
+        if (pos > covered)
+        {
+            this->addHole(covered, pos);
+        }
+        if (status != "+")
+        {
+            this->addHole(pos, pos + size);
+        }
+        covered = pos + size;
+    }
+
+    if (statusLine)
+    {
+        throw std::invalid_argument("File " + mapfilePath + " is not a ddrescue mapfile.");
+    }
+    if (covered < this->image->driveSize())
+    {
+        this->addHole(covered, this->image->driveSize());
+    }
+}
+
+void DdrescueImageReader::addHole(u64 start, u64 end)
+{
+    if (start == end)
+    {
+        return;
+    }
+
+    // Blocks come in order, so hole can only touch the last one
+    if (!this->holes.empty() && std::prev(this->holes.end())->second == start)
+    {
+        std::prev(this->holes.end())->second = end;
+        return;
+    }
+
+    this->holes[start] = end;
+}
+
+bool DdrescueImageReader::isRescued(u64 offset, u64 len)
+{
+    // Last hole starting before the end of range is the only one which can overlap it
+    auto it = this->holes.lower_bound(offset + len);
+    if (it == this->holes.begin())
+    {
+        return true;
+    }
+
+    it--;
+    return it->second <= offset;
+}
+
+void DdrescueImageReader::checkRescued(u64 offset, u64 len)
+{
+    if (!this->isRescued(offset, len))
+    {
+        std::stringstream errMsg;
+        errMsg << "Reading " << this->driveName << " at offset " << offset
+               << " has failed. Reason: This area wasn't rescued by ddrescue.";
+        throw std::runtime_error(errMsg.str());
+    }
+}
+
+} // end namespace sg
@@ -1,5 +1,8 @@
 #include "drive_reader.hpp"
 #include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <linux/fs.h>
@@ -7,27 +10,66 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
 
 namespace sg
 {
 
+int DriveReader::readv(const iovec* iov, int iovcnt, u64 offset)
+{
+    for (int i = 0; i < iovcnt; i++)
+    {
+        int rc = this->read(iov[i].iov_base, iov[i].iov_len, offset);
+        if (rc != 0)
+        {
+            return rc;
+        }
+        offset += iov[i].iov_len;
+    }
+
+    return 0;
+}
+
+int DriveReader::fileDescriptorFor(const void* buf, u32 len, u64 offset)
+{
+    return -1;
+}
+
+bool DriveReader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    return false;
+}
+
+std::vector<std::pair<u64, u64>> DriveReader::unreadableRanges()
+{
+    return {};
+}
+
+void DriveReader::printStats(std::ostream& out)
+{
+}
+
 std::string DriveReader::name()
 {
     return this->driveName;
 }
 
-BlockDeviceReader::BlockDeviceReader(std::string path)
+// Bounce buffer is used with O_DIRECT when caller's request is not aligned.
+const u32 DIRECT_IO_BOUNCE_BUFFER_SIZE = 1024 * 1024;
+
+BlockDeviceReader::BlockDeviceReader(std::string path, bool directIo)
 {
-    this->size = this->readDriveSize(path);
+    this->path = path;
     this->driveName = path;
+    this->directIo = directIo;
 
-    // Yeah, I use linux syscalls to read drive sizes and here
-    // I use ifstream, I could use just syscalls
-    // But they're scary and I am too lazy to read how to process errors
-    // from them. So I'll stick with ifstream, at least for now.
-    this->devstream = std::ifstream(path, std::ios::binary);
+    // I am using plain file descriptor with pread instead of ifstream.
+    // pread doesn't move any file position, so reads from many threads
+    // won't step on each other and data goes straight into caller's buffer.
+    this->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | (directIo ? O_DIRECT : 0));
 
-    if (!this->devstream.is_open())
+    if (this->fd == -1)
     {
         std::stringstream errMsgStream;
         errMsgStream << "Could not open drive "
@@ -36,25 +78,199 @@ BlockDeviceReader::BlockDeviceReader(std::string path)
 
         throw std::runtime_error(errMsgStream.str());
     }
+
+    try
+    {
+        this->size = this->readDriveSize();
+        this->logicalBlockSize = this->readLogicalBlockSize();
+    }
+    catch (...)
+    {
+        close(this->fd);
+        throw;
+    }
+
+    if (directIo)
+    {
+        // Page alignment is fine for any logical block size up to 4KiB
+        size_t alignment = std::max<size_t>(this->logicalBlockSize, 4096);
+        this->bouncePool = std::make_unique<AlignedBufferPool>(DIRECT_IO_BOUNCE_BUFFER_SIZE, alignment);
+    }
+}
+
+BlockDeviceReader::~BlockDeviceReader()
+{
+    close(this->fd);
 }
 
 int BlockDeviceReader::read(void *buf, u32 len, u64 offset)
 {
-    this->devstream.seekg(offset);
-    this->devstream.read((char*)buf, len);
+    if (this->directIo && !this->isAligned(buf, len, offset))
+    {
+        this->readThroughBounceBuffer(buf, len, offset);
+        return 0;
+    }
+
+    this->readAligned(buf, len, offset);
+    return 0;
+}
+
+void BlockDeviceReader::readAligned(void *buf, u32 len, u64 offset)
+{
+    this->readAligned(buf, len, offset, len);
+}
 
-    if (this->devstream.fail())
+u32 BlockDeviceReader::readAligned(void *buf, u32 len, u64 offset, u32 minLen)
+{
+    char* out = static_cast<char*>(buf);
+    u32 done = 0;
+
+    // With O_DIRECT read of the last block of a file, which isn't whole, returns
+    // less than asked for. Reading on from unaligned offset would fail, so we stop
+    // as soon as we have what's needed.
+    while (done < minLen)
     {
-        std::stringstream errMsg;
-        errMsg << "Reading from drive " << this->name() << " has failed. ";
-        if (this->devstream.eof()) {
-            errMsg << "Reason: end of file.";
+        ssize_t bytesRead = pread(this->fd, out, len, offset);
+
+        if (bytesRead == -1 && errno == EINTR)
+        {
+            continue;
         }
-        else {
-            errMsg << "Reason: unknown, errno: " << strerror(errno);
+        if (bytesRead <= 0)
+        {
+            // pread returning 0 means we hit the end of the drive
+            this->throwReadError(offset, bytesRead == 0 ? 0 : errno);
         }
 
-        throw std::runtime_error(errMsg.str());
+        // Short reads are fine, we just continue from where we've stopped
+        out += bytesRead;
+        offset += bytesRead;
+        len -= bytesRead;
+        done += bytesRead;
+    }
+
+    return done;
+}
+
+void BlockDeviceReader::readThroughBounceBuffer(void *buf, u32 len, u64 offset)
+{
+    // We read whole aligned blocks covering requested range into
+    // aligned bounce buffer and copy only requested bytes from it.
+    char* out = static_cast<char*>(buf);
+    auto bounce = this->bouncePool->acquire();
+    u64 blockMask = this->logicalBlockSize - 1;
+
+    while (len > 0)
+    {
+        u64 alignedOffset = offset & ~blockMask;
+        u32 skip = offset - alignedOffset;
+        u64 alignedLen = (skip + len + blockMask) & ~blockMask;
+        alignedLen = std::min<u64>(alignedLen, bounce.size());
+
+        // Don't ask for blocks past the end of the drive, the last one can be partial in image files
+        if (alignedOffset < this->size)
+        {
+            alignedLen = std::min<u64>(alignedLen, (this->size - alignedOffset + blockMask) & ~blockMask);
+        }
+
+        u32 chunk = std::min<u64>(alignedLen - skip, len);
+        this->readAligned(bounce.data(), alignedLen, alignedOffset, skip + chunk);
+
+        memcpy(out, bounce.data() + skip, chunk);
+
+        out += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+}
+
+bool BlockDeviceReader::isAligned(const void* buf, u64 len, u64 offset)
+{
+    u64 blockMask = this->logicalBlockSize - 1;
+    return (reinterpret_cast<uintptr_t>(buf) & blockMask) == 0
+        && (len & blockMask) == 0
+        && (offset & blockMask) == 0;
+}
+
+int BlockDeviceReader::fileDescriptorFor(const void* buf, u32 len, u64 offset)
+{
+    if (this->directIo && !this->isAligned(buf, len, offset))
+    {
+        // This one needs bounce buffer
+        return -1;
+    }
+
+    return this->fd;
+}
+
+bool BlockDeviceReader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    if (this->directIo)
+    {
+        // Data would be taken from page cache, which is what O_DIRECT is meant to avoid
+        return false;
+    }
+
+    if (!extents.empty() && extents.back().fd == this->fd &&
+        extents.back().offset + extents.back().len == offset)
+    {
+        extents.back().len += len;
+        return true;
+    }
+
+    extents.push_back({ this->fd, offset, len });
+    return true;
+}
+
+int BlockDeviceReader::readv(const iovec* iov, int iovcnt, u64 offset)
+{
+    if (this->directIo)
+    {
+        u64 iovOffset = offset;
+        for (int i = 0; i < iovcnt; i++)
+        {
+            if (!this->isAligned(iov[i].iov_base, iov[i].iov_len, iovOffset))
+            {
+                // This buffer needs alignment fixups, so let read() handle them one by one
+                return DriveReader::readv(iov, iovcnt, offset);
+            }
+            iovOffset += iov[i].iov_len;
+        }
+    }
+
+    // preadv can stop in the middle of any buffer,
+    // so I work on a copy which I can move forward.
+    std::vector<iovec> remaining(iov, iov + iovcnt);
+    iovec* current = remaining.data();
+    int currentCount = iovcnt;
+
+    while (currentCount > 0)
+    {
+        ssize_t bytesRead = preadv(this->fd, current, std::min(currentCount, IOV_MAX), offset);
+
+        if (bytesRead == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytesRead <= 0)
+        {
+            this->throwReadError(offset, bytesRead == 0 ? 0 : errno);
+        }
+
+        offset += bytesRead;
+
+        while (currentCount > 0 && static_cast<size_t>(bytesRead) >= current->iov_len)
+        {
+            bytesRead -= current->iov_len;
+            current++;
+            currentCount--;
+        }
+
+        if (currentCount > 0)
+        {
+            current->iov_base = static_cast<char*>(current->iov_base) + bytesRead;
+            current->iov_len -= bytesRead;
+        }
     }
 
     return 0;
@@ -65,29 +281,34 @@ u64 BlockDeviceReader::driveSize()
     return this->size;
 }
 
-u64 BlockDeviceReader::readDriveSize(std::string path)
+u64 BlockDeviceReader::readDriveSize()
 {
-    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
 
-    if (fd == -1)
+    if (fstat(this->fd, &st) != 0)
     {
         std::stringstream errMsgStream;
         errMsgStream << "Could not read size of drive "
-            << path << "; Reason: "
+            << this->path << "; Reason: "
             << strerror(errno);
 
         throw std::runtime_error(errMsgStream.str());
     }
 
+    // Regular files are here so you can work on drive images
+    if (S_ISREG(st.st_mode))
+    {
+        return st.st_size;
+    }
+
     size_t driveSize = 0;
-    int rc = ioctl(fd, BLKGETSIZE64, &driveSize);
-    close(fd);
+    int rc = ioctl(this->fd, BLKGETSIZE64, &driveSize);
 
     if (rc != 0)
     {
         std::stringstream errMsgStream;
         errMsgStream << "Could not read size of drive "
-            << path << "; Reason: "
+            << this->path << "; Reason: "
             << strerror(errno);
 
         throw std::runtime_error(errMsgStream.str());
@@ -96,4 +317,31 @@ u64 BlockDeviceReader::readDriveSize(std::string path)
     return driveSize;
 }
 
+u32 BlockDeviceReader::readLogicalBlockSize()
+{
+    int blockSize = 0;
+
+    if (ioctl(this->fd, BLKSSZGET, &blockSize) != 0 || blockSize <= 0)
+    {
+        // Not a block device, most likely image file. 4KiB is safe for O_DIRECT on any filesystem.
+        return 4096;
+    }
+
+    return blockSize;
+}
+
+void BlockDeviceReader::throwReadError(u64 offset, int error)
+{
+    std::stringstream errMsg;
+    errMsg << "Reading from drive " << this->name() << " at offset " << offset << " has failed. ";
+    if (error == 0) {
+        errMsg << "Reason: end of file.";
+    }
+    else {
+        errMsg << "Reason: " << strerror(error);
+    }
+
+    throw std::runtime_error(errMsg.str());
+}
+
 } // end namespace sg
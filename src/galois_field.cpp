@@ -0,0 +1,215 @@
+#include "galois_field.hpp"
+#include <stdexcept>
+#include <immintrin.h>
+
+namespace sg
+{
+
+struct GaloisFieldTables
+{
+    // exp is twice as long, so exp[log[a] + log[b]] doesn't need modulo
+    u8 exp[512];
+    u8 log[256];
+    // mul[c] is whole multiplication table for coefficient c, 64KiB in total.
+    u8 mul[256][256];
+
+    GaloisFieldTables()
+    {
+        // 2 is generator of this field, so its powers go thru every non zero element
+        u16 x = 1;
+        for (int i = 0; i < 255; i++)
+        {
+            this->exp[i] = x;
+            this->exp[i + 255] = x;
+            this->log[x] = i;
+
+            x <<= 1;
+            if (x & 0x100)
+            {
+                x ^= GF_POLYNOMIAL;
+            }
+        }
+        this->exp[510] = this->exp[0];
+        this->exp[511] = this->exp[1];
+        this->log[0] = 0;
+
+        for (int a = 0; a < 256; a++)
+        {
+            for (int b = 0; b < 256; b++)
+            {
+                this->mul[a][b] = (a == 0 || b == 0) ? 0 : this->exp[this->log[a] + this->log[b]];
+            }
+        }
+    }
+};
+
+static const GaloisFieldTables tables;
+
+u8 gfMultiply(u8 a, u8 b)
+{
+    return tables.mul[a][b];
+}
+
+u8 gfInverse(u8 a)
+{
+    if (a == 0)
+    {
+        throw std::invalid_argument("Zero has no inverse in Galois field.");
+    }
+    return tables.exp[255 - tables.log[a]];
+}
+
+// Multiplication of region by a constant. Every variant handles bytes from start to len,
+// out = c * src, or out ^= c * src if accumulate is set. SIMD variants use split nibble trick:
+// c * x = c * (x & 0x0f) ^ c * (x & 0xf0), both halves have only 16 possible values,
+// so they fit in one 16 byte register and PSHUFB can look up 16 (or 32, 64) bytes at once.
+typedef void (*GfRangeFunction)(u8* out, const u8* src, u8 coefficient, size_t start, size_t len, bool accumulate);
+
+static void gfRegionScalar(u8* out, const u8* src, u8 coefficient, size_t start, size_t len, bool accumulate)
+{
+    const u8* row = tables.mul[coefficient];
+
+    for (size_t i = start; i < len; i++)
+    {
+        out[i] = (accumulate ? out[i] : 0) ^ row[src[i]];
+    }
+}
+
+struct NibbleTables
+{
+    alignas(16) u8 low[16];
+    alignas(16) u8 high[16];
+
+    NibbleTables(u8 coefficient)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            this->low[i] = tables.mul[coefficient][i];
+            this->high[i] = tables.mul[coefficient][i << 4];
+        }
+    }
+};
+
+__attribute__((target("ssse3")))
+static void gfRegionSsse3(u8* out, const u8* src, u8 coefficient, size_t start, size_t len, bool accumulate)
+{
+    NibbleTables nibbles(coefficient);
+    __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(nibbles.low));
+    __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(nibbles.high));
+    __m128i mask = _mm_set1_epi8(0x0f);
+
+    size_t i = start;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_shuffle_epi8(low, _mm_and_si128(x, mask));
+        __m128i hi = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        __m128i product = _mm_xor_si128(lo, hi);
+
+        if (accumulate)
+        {
+            product = _mm_xor_si128(product, _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), product);
+    }
+
+    gfRegionScalar(out, src, coefficient, i, len, accumulate);
+}
+
+__attribute__((target("avx2")))
+static void gfRegionAvx2(u8* out, const u8* src, u8 coefficient, size_t start, size_t len, bool accumulate)
+{
+    NibbleTables nibbles(coefficient);
+    // PSHUFB works within 128 bit lanes, so tables are repeated in both lanes
+    __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(nibbles.low)));
+    __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(nibbles.high)));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+
+    size_t i = start;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i lo = _mm256_shuffle_epi8(low, _mm256_and_si256(x, mask));
+        __m256i hi = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+        __m256i product = _mm256_xor_si256(lo, hi);
+
+        if (accumulate)
+        {
+            product = _mm256_xor_si256(product, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), product);
+    }
+
+    gfRegionSsse3(out, src, coefficient, i, len, accumulate);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gfRegionAvx512(u8* out, const u8* src, u8 coefficient, size_t start, size_t len, bool accumulate)
+{
+    NibbleTables nibbles(coefficient);
+    __m512i low = _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(nibbles.low)));
+    __m512i high = _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(nibbles.high)));
+    __m512i mask = _mm512_set1_epi8(0x0f);
+
+    size_t i = start;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m512i x = _mm512_loadu_si512(src + i);
+        __m512i lo = _mm512_shuffle_epi8(low, _mm512_and_si512(x, mask));
+        __m512i hi = _mm512_shuffle_epi8(high, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask));
+        __m512i product = _mm512_xor_si512(lo, hi);
+
+        if (accumulate)
+        {
+            product = _mm512_xor_si512(product, _mm512_loadu_si512(out + i));
+        }
+        _mm512_storeu_si512(out + i, product);
+    }
+
+    gfRegionAvx2(out, src, coefficient, i, len, accumulate);
+}
+
+// Runs range variant on whole region
+template <GfRangeFunction gfRange>
+static void gfWhole(void* out, const void* src, u8 coefficient, size_t len, bool accumulate)
+{
+    gfRange(static_cast<u8*>(out), static_cast<const u8*>(src), coefficient, 0, len, accumulate);
+}
+
+std::vector<GfKernel> gfKernels()
+{
+    __builtin_cpu_init();
+    std::vector<GfKernel> kernels = { { "scalar", gfWhole<gfRegionScalar> } };
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        kernels.push_back({ "ssse3", gfWhole<gfRegionSsse3> });
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.push_back({ "avx2", gfWhole<gfRegionAvx2> });
+    }
+    if (__builtin_cpu_supports("avx512bw"))
+    {
+        kernels.push_back({ "avx512", gfWhole<gfRegionAvx512> });
+    }
+    return kernels;
+}
+
+static const GfKernel gfKernel = gfKernels().back();
+
+void gfMultiplyXor(void* out, const void* src, u8 coefficient, size_t len)
+{
+    gfKernel.function(out, src, coefficient, len, true);
+}
+
+void gfMultiplyInto(void* out, const void* src, u8 coefficient, size_t len)
+{
+    gfKernel.function(out, src, coefficient, len, false);
+}
+
+const char* gfKernelName()
+{
+    return gfKernel.name;
+}
+
+} // end namespace sg
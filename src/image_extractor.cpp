@@ -0,0 +1,416 @@
+#include "image_extractor.hpp"
+#include "xor_kernel.hpp"
+#include "progress_monitor.hpp"
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace sg
+{
+
+static const char* CHECKPOINT_HEADER = "hewlett-extract checkpoint";
+
+static std::string formatSize(u64 bytes)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (bytes < 1024 * 1024 * 1024)
+    {
+        out << bytes / (1024.0 * 1024) << " MiB";
+    }
+    else
+    {
+        out << bytes / (1024.0 * 1024 * 1024) << " GiB";
+    }
+    return out.str();
+}
+
+ImageExtractor::ImageExtractor(DriveReader& reader, const ImageExtractorOptions& options)
+    : reader(reader), options(options)
+{
+    if (options.chunkSize == 0 || options.chunkSize % 4096 != 0)
+    {
+        throw std::invalid_argument("Chunk size has to be a multiple of 4096 bytes.");
+    }
+    if (options.threads == 0)
+    {
+        throw std::invalid_argument("At least one thread is needed to read the array.");
+    }
+    if (options.resume && options.checkpointPath.empty())
+    {
+        throw std::invalid_argument("Resuming needs checkpoint file.");
+    }
+
+    this->size = reader.driveSize();
+}
+
+ImageExtractor::~ImageExtractor()
+{
+    if (this->fd >= 0)
+    {
+        close(this->fd);
+    }
+}
+
+bool ImageExtractor::run()
+{
+    this->startOffset = this->options.resume ? this->loadCheckpoint() : 0;
+    this->openOutput();
+
+    // Chunks are counted from start offset, so copy can be resumed with different chunk size
+    u64 chunkCount = (this->size - this->startOffset + this->options.chunkSize - 1) / this->options.chunkSize;
+
+    // Readers inherit its signal mask, so signals wait for the writer, which saves checkpoint before leaving
+    ProgressMonitor progress(this->size, this->startOffset, 1, [](u64 done, u64 total) {
+        return formatSize(done) + " / " + formatSize(total);
+    });
+
+    AlignedBufferPool pool(this->options.chunkSize, 4096);
+    std::vector<std::thread> readers;
+    for (u32 i = 0; i < this->options.threads; i++)
+    {
+        readers.emplace_back(&ImageExtractor::readLoop, this, std::ref(pool), chunkCount);
+    }
+
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    bool interrupted = false;
+    std::exception_ptr error;
+
+    try
+    {
+        while (true)
+        {
+            std::unique_ptr<Chunk> chunk;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                if (this->nextToWrite == chunkCount || this->readError)
+                {
+                    break;
+                }
+
+                progress.wait(this->chunkRead, lock, [this]() {
+                    return this->readError || this->readChunks.contains(this->nextToWrite);
+                });
+
+                auto it = this->readChunks.find(this->nextToWrite);
+                if (it != this->readChunks.end())
+                {
+                    chunk = std::move(it->second);
+                    this->readChunks.erase(it);
+                }
+            }
+
+            if (chunk)
+            {
+                this->writeChunk(this->writtenUntil(), *chunk);
+                chunk.reset();
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->nextToWrite++;
+                }
+                this->chunkWritten.notify_all();
+            }
+
+            if (progress.interrupted())
+            {
+                interrupted = true;
+                break;
+            }
+            progress.update(this->writtenUntil());
+
+            auto now = std::chrono::steady_clock::now();
+            if (!this->options.checkpointPath.empty() &&
+                now - lastCheckpoint >= std::chrono::seconds(this->options.checkpointInterval))
+            {
+                this->saveCheckpoint(this->writtenUntil());
+                lastCheckpoint = now;
+            }
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->chunkWritten.notify_all();
+    for (auto& thread : readers)
+    {
+        thread.join();
+    }
+    // Their buffers go back to the pool, which is about to be destroyed
+    this->readChunks.clear();
+
+    this->seconds = progress.finish();
+
+    if (!error)
+    {
+        error = this->readError;
+    }
+
+    u64 done = this->writtenUntil();
+    if (error || interrupted)
+    {
+        if (!this->options.checkpointPath.empty())
+        {
+            this->saveCheckpoint(done);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+
+    if (fdatasync(this->fd) != 0 && errno != EINVAL)
+    {
+        throw std::runtime_error(std::string("Flushing output has failed. Reason: ") + strerror(errno));
+    }
+    if (!this->options.checkpointPath.empty())
+    {
+        unlink(this->options.checkpointPath.c_str());
+    }
+
+    return true;
+}
+
+u64 ImageExtractor::writtenUntil()
+{
+    return std::min(this->size, this->startOffset + this->nextToWrite * this->options.chunkSize);
+}
+
+void ImageExtractor::printSummary(std::ostream& out)
+{
+    u64 copied = this->bytesWritten + this->bytesSkipped;
+    out << "Copied " << formatSize(copied) << " in " << std::fixed << std::setprecision(1) << this->seconds << " s";
+    if (this->seconds > 0)
+    {
+        out << " (" << copied / this->seconds / 1e6 << " MB/s)";
+    }
+    if (this->sparse)
+    {
+        out << ", " << formatSize(this->bytesSkipped) << " of zeros left as holes";
+    }
+    out << std::endl;
+}
+
+void ImageExtractor::openOutput()
+{
+    this->fd = open(this->options.outputPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (this->fd < 0)
+    {
+        throw std::runtime_error("Opening output " + this->options.outputPath + " has failed. Reason: " + strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(this->fd, &st) != 0)
+    {
+        throw std::runtime_error(std::string("Checking output has failed. Reason: ") + strerror(errno));
+    }
+
+    if (S_ISREG(st.st_mode))
+    {
+        // Fresh copy starts from empty file, so skipped zeros are holes and not old data
+        if ((this->startOffset == 0 && ftruncate(this->fd, 0) != 0) || ftruncate(this->fd, this->size) != 0)
+        {
+            throw std::runtime_error(std::string("Resizing output has failed. Reason: ") + strerror(errno));
+        }
+        this->sparse = this->options.sparseBlockSize > 0;
+    }
+    else if (S_ISBLK(st.st_mode))
+    {
+        u64 deviceSize = 0;
+        if (ioctl(this->fd, BLKGETSIZE64, &deviceSize) != 0)
+        {
+            throw std::runtime_error(std::string("Reading output device size has failed. Reason: ") + strerror(errno));
+        }
+        if (deviceSize < this->size)
+        {
+            throw std::invalid_argument(
+                "Output device has " + std::to_string(deviceSize) +
+                " bytes, it's smaller than the array of " + std::to_string(this->size) + " bytes.");
+        }
+    }
+}
+
+void ImageExtractor::readLoop(AlignedBufferPool& pool, u64 chunkCount)
+{
+    while (true)
+    {
+        u64 index;
+        {
+            // Reads don't go too far ahead of the writer, so memory stays at few chunks per thread
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->chunkWritten.wait(lock, [this, chunkCount]() {
+                return this->stopping || this->nextToRead == chunkCount ||
+                       this->nextToRead < this->nextToWrite + 2 * this->options.threads;
+            });
+            if (this->stopping || this->nextToRead == chunkCount)
+            {
+                return;
+            }
+            index = this->nextToRead++;
+        }
+
+        auto chunk = std::make_unique<Chunk>(pool);
+        u64 offset = this->startOffset + index * this->options.chunkSize;
+        chunk->len = std::min<u64>(this->options.chunkSize, this->size - offset);
+
+        try
+        {
+            if (this->reader.read(chunk->buffer.data(), chunk->len, offset) < 0)
+            {
+                throw std::runtime_error("Reading array at offset " + std::to_string(offset) + " has failed.");
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (!this->readError)
+            {
+                this->readError = std::current_exception();
+            }
+            this->stopping = true;
+            this->chunkRead.notify_all();
+            this->chunkWritten.notify_all();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->readChunks[index] = std::move(chunk);
+        }
+        this->chunkRead.notify_all();
+    }
+}
+
+void ImageExtractor::writeChunk(u64 offset, Chunk& chunk)
+{
+    const char* data = chunk.buffer.data();
+    if (!this->sparse)
+    {
+        this->writeAll(data, chunk.len, offset);
+        this->bytesWritten += chunk.len;
+        return;
+    }
+
+    // Runs of non zero blocks are written with one write, zero blocks are skipped
+    u32 block = this->options.sparseBlockSize;
+    u32 pos = 0;
+    while (pos < chunk.len)
+    {
+        u32 runStart = pos;
+        while (pos < chunk.len && !isZero(data + pos, std::min(block, chunk.len - pos)))
+        {
+            pos += std::min(block, chunk.len - pos);
+        }
+        if (pos > runStart)
+        {
+            this->writeAll(data + runStart, pos - runStart, offset + runStart);
+            this->bytesWritten += pos - runStart;
+        }
+
+        while (pos < chunk.len && isZero(data + pos, std::min(block, chunk.len - pos)))
+        {
+            this->bytesSkipped += std::min(block, chunk.len - pos);
+            pos += std::min(block, chunk.len - pos);
+        }
+    }
+}
+
+void ImageExtractor::writeAll(const char* buf, u64 len, u64 offset)
+{
+    while (len > 0)
+    {
+        ssize_t written = pwrite(this->fd, buf, len, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error(
+                "Writing output at offset " + std::to_string(offset) + " has failed. Reason: " + strerror(errno));
+        }
+
+        buf += written;
+        len -= written;
+        offset += written;
+    }
+}
+
+u64 ImageExtractor::loadCheckpoint()
+{
+    std::ifstream file(this->options.checkpointPath);
+    if (!file)
+    {
+        std::cerr << "No checkpoint at " << this->options.checkpointPath << ", starting from the beginning." << std::endl;
+        return 0;
+    }
+
+    std::string header;
+    std::getline(file, header);
+    std::string sizeKey, offsetKey;
+    u64 size, offset;
+    file >> sizeKey >> size >> offsetKey >> offset;
+
+    if (!file || header != CHECKPOINT_HEADER || sizeKey != "size" || offsetKey != "offset")
+    {
+        throw std::invalid_argument("File " + this->options.checkpointPath + " is not a valid checkpoint.");
+    }
+    if (size != this->size || offset > size)
+    {
+        throw std::invalid_argument(
+            "Checkpoint " + this->options.checkpointPath + " was saved for array of " + std::to_string(size) +
+            " bytes, but this one has " + std::to_string(this->size) + " bytes. Check array options.");
+    }
+
+    std::cerr << "Resuming from " << formatSize(offset) << "." << std::endl;
+    return offset;
+}
+
+void ImageExtractor::saveCheckpoint(u64 offset)
+{
+    // Everything before offset has to be on disk before checkpoint says so
+    if (fdatasync(this->fd) != 0 && errno != EINVAL)
+    {
+        throw std::runtime_error(std::string("Flushing output has failed. Reason: ") + strerror(errno));
+    }
+
+    // Written next to the old one and renamed over it, so there's always one whole checkpoint
+    std::string tmpPath = this->options.checkpointPath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        file << CHECKPOINT_HEADER << "\n"
+             << "size " << this->size << "\n"
+             << "offset " << offset << "\n";
+        file.flush();
+        if (!file)
+        {
+            throw std::runtime_error("Writing checkpoint " + tmpPath + " has failed.");
+        }
+    }
+
+    if (rename(tmpPath.c_str(), this->options.checkpointPath.c_str()) != 0)
+    {
+        throw std::runtime_error("Saving checkpoint " + this->options.checkpointPath + " has failed. Reason: " + strerror(errno));
+    }
+}
+
+} // end namespace sg
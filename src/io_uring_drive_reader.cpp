@@ -0,0 +1,244 @@
+#include "io_uring_drive_reader.hpp"
+#include "io_uring_queue.hpp"
+#include <errno.h>
+#include <string.h>
+#include <memory>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace sg
+{
+
+// Reading from nested RAID reader (like RAID 5 groups in RAID 50) calls readAll
+// again on the same thread while outer requests are still in flight.
+// So each nesting level gets its own ring, otherwise they would steal each other's completions.
+static thread_local std::vector<std::unique_ptr<IoUringQueue>> threadQueues;
+static thread_local size_t nestingLevel = 0;
+
+struct NestingLevelGuard
+{
+    NestingLevelGuard() { nestingLevel++; }
+    ~NestingLevelGuard() { nestingLevel--; }
+};
+
+// Returns file descriptor if whole request can go thru io_uring, -1 otherwise
+static int fileDescriptorForRequest(ReadRequest& request)
+{
+    if (request.iovcnt == 0)
+    {
+        return request.drive->fileDescriptorFor(request.buf, request.len, request.offset);
+    }
+
+    int fd = -1;
+    u64 offset = request.offset;
+    for (int i = 0; i < request.iovcnt; i++)
+    {
+        int iovFd = request.drive->fileDescriptorFor(request.iov[i].iov_base, request.iov[i].iov_len, offset);
+        if (iovFd < 0 || (fd >= 0 && iovFd != fd))
+        {
+            return -1;
+        }
+        fd = iovFd;
+        offset += request.iov[i].iov_len;
+    }
+
+    return fd;
+}
+
+// Reads the rest of vectored request after short read, it's rare enough to do it synchronously
+static void readRemainder(ReadRequest& request, u32 done)
+{
+    std::vector<iovec> remaining;
+    u32 skip = done;
+    for (int i = 0; i < request.iovcnt; i++)
+    {
+        iovec iov = request.iov[i];
+        if (skip >= iov.iov_len)
+        {
+            skip -= iov.iov_len;
+            continue;
+        }
+        iov.iov_base = static_cast<char*>(iov.iov_base) + skip;
+        iov.iov_len -= skip;
+        skip = 0;
+        remaining.push_back(iov);
+    }
+
+    request.drive->readv(remaining.data(), remaining.size(), request.offset + done);
+}
+
+IoUringDriveReader::IoUringDriveReader(u32 queueDepth)
+{
+    this->queueDepth = queueDepth;
+}
+
+bool IoUringDriveReader::isSupported()
+{
+    try
+    {
+        // io_uring itself is in Linux 5.1, but IORING_OP_READ only since 5.6
+        IoUringQueue queue(1);
+        return queue.supportsOpcode(IORING_OP_READ) && queue.supportsOpcode(IORING_OP_READV);
+    }
+    catch (std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+void IoUringDriveReader::readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted)
+{
+    if (threadQueues.size() <= nestingLevel)
+    {
+        threadQueues.push_back(std::make_unique<IoUringQueue>(this->queueDepth));
+    }
+    IoUringQueue& queue = *threadQueues[nestingLevel];
+    NestingLevelGuard guard;
+
+    // How many bytes of each request are already read, kernel can return short reads.
+    std::vector<u32> done(requests.size(), 0);
+    std::vector<int> fds(requests.size());
+    std::vector<size_t> synchronous;
+    size_t nextToQueue = 0;
+    u32 inFlight = 0;
+    std::string error;
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        auto& request = requests[i];
+        fds[i] = fileDescriptorForRequest(request);
+        if (fds[i] < 0)
+        {
+            synchronous.push_back(i);
+        }
+    }
+
+    auto recordError = [&](const std::string& message) {
+        if (error.empty())
+        {
+            error = message;
+        }
+    };
+
+    // Callback must not throw while kernel is still writing into our buffers
+    auto completed = [&](ReadRequest& request) {
+        try
+        {
+            if (onCompleted)
+            {
+                onCompleted(request);
+            }
+        }
+        catch (std::exception& ex)
+        {
+            recordError(ex.what());
+        }
+    };
+
+    auto queueNext = [&]() {
+        while (nextToQueue < requests.size() && inFlight < queue.capacity())
+        {
+            size_t i = nextToQueue++;
+            if (fds[i] >= 0)
+            {
+                auto& request = requests[i];
+                if (request.iovcnt > 0)
+                {
+                    queue.queueReadv(fds[i], request.iov, request.iovcnt, request.offset, i);
+                }
+                else
+                {
+                    queue.queueRead(fds[i], request.buf, request.len, request.offset, i);
+                }
+                inFlight++;
+            }
+        }
+    };
+
+    queueNext();
+
+    if (inFlight > 0)
+    {
+        // Just push the requests to the kernel, we'll wait for completions later
+        queue.submit(0);
+    }
+
+    // Requests that can't go thru io_uring are read now, while drives are busy with the rest.
+    for (size_t i : synchronous)
+    {
+        auto& request = requests[i];
+        try
+        {
+            readRequest(request);
+        }
+        catch (std::exception& ex)
+        {
+            recordError(ex.what());
+            continue;
+        }
+        completed(request);
+    }
+
+    while (inFlight > 0)
+    {
+        queue.submit(1);
+
+        io_uring_cqe cqe;
+        while (queue.popCompletion(cqe))
+        {
+            inFlight--;
+            size_t i = cqe.user_data;
+            auto& request = requests[i];
+
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+            {
+                cqe.res = 0;
+            }
+            else if (cqe.res <= 0)
+            {
+                std::stringstream errMsg;
+                errMsg << "Reading from drive " << request.drive->name()
+                       << " at offset " << request.offset + done[i] << " has failed. Reason: "
+                       << (cqe.res == 0 ? "end of file." : strerror(-cqe.res));
+                recordError(errMsg.str());
+                continue;
+            }
+
+            done[i] += cqe.res;
+            if (done[i] < request.len && request.iovcnt > 0)
+            {
+                try
+                {
+                    readRemainder(request, done[i]);
+                }
+                catch (std::exception& ex)
+                {
+                    recordError(ex.what());
+                    continue;
+                }
+                completed(request);
+            }
+            else if (done[i] < request.len)
+            {
+                // Short read, queue the rest of it
+                queue.queueRead(fds[i], static_cast<char*>(request.buf) + done[i],
+                                request.len - done[i], request.offset + done[i], i);
+                inFlight++;
+            }
+            else
+            {
+                completed(request);
+            }
+        }
+
+        queueNext();
+    }
+
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+}
+
+} // end namespace sg
@@ -0,0 +1,130 @@
+#include "io_uring_queue.hpp"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace sg
+{
+
+static int ioUringSetup(u32 entries, io_uring_params* params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, u32 toSubmit, u32 minComplete, u32 flags)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int ioUringRegister(int fd, u32 opcode, void* arg, u32 count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+IoUringQueue::IoUringQueue(u32 entries, u32 flags)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = flags;
+
+    this->fd = ioUringSetup(entries, &params);
+    if (this->fd < 0)
+    {
+        throw std::runtime_error(std::string("io_uring_setup has failed. Reason: ") + strerror(errno));
+    }
+
+    this->sqeSize = flags & IORING_SETUP_SQE128 ? 2 * sizeof(io_uring_sqe) : sizeof(io_uring_sqe);
+    this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // Since 5.4 both rings can be mapped with one mmap
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+    }
+
+    this->sqRing = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+    this->cqRing = singleMmap ? this->sqRing : mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+    this->sqesSize = params.sq_entries * this->sqeSize;
+    this->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES));
+
+    if (this->sqRing == MAP_FAILED || this->cqRing == MAP_FAILED || this->sqes == MAP_FAILED)
+    {
+        int error = errno;
+        this->unmap();
+        close(this->fd);
+        throw std::runtime_error(std::string("Mapping io_uring queues has failed. Reason: ") + strerror(error));
+    }
+
+    char* sq = static_cast<char*>(this->sqRing);
+    this->sqHead = reinterpret_cast<u32*>(sq + params.sq_off.head);
+    this->sqTail = reinterpret_cast<u32*>(sq + params.sq_off.tail);
+    this->sqMask = *reinterpret_cast<u32*>(sq + params.sq_off.ring_mask);
+    this->sqArray = reinterpret_cast<u32*>(sq + params.sq_off.array);
+    this->sqEntries = params.sq_entries;
+
+    char* cq = static_cast<char*>(this->cqRing);
+    this->cqHead = reinterpret_cast<u32*>(cq + params.cq_off.head);
+    this->cqTail = reinterpret_cast<u32*>(cq + params.cq_off.tail);
+    this->cqMask = *reinterpret_cast<u32*>(cq + params.cq_off.ring_mask);
+    this->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUringQueue::~IoUringQueue()
+{
+    this->unmap();
+    close(this->fd);
+}
+
+bool IoUringQueue::supportsOpcode(u8 opcode)
+{
+    // Probe ends with array of operations, one for every opcode kernel could know
+    const u32 maxOps = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + maxOps * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+
+    if (ioUringRegister(this->fd, IORING_REGISTER_PROBE, probe, maxOps) < 0)
+    {
+        return false;
+    }
+
+    return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+}
+
+void IoUringQueue::submit(u32 minComplete)
+{
+    while (true)
+    {
+        int rc = ioUringEnter(this->fd, this->queued, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (rc >= 0)
+        {
+            this->queued -= std::min<u32>(rc, this->queued);
+            if (this->queued == 0)
+            {
+                return;
+            }
+            continue;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            throw std::runtime_error(std::string("io_uring_enter has failed. Reason: ") + strerror(errno));
+        }
+    }
+}
+
+void IoUringQueue::unmap()
+{
+    if (this->sqes != MAP_FAILED) munmap(this->sqes, this->sqesSize);
+    if (this->cqRing != MAP_FAILED && this->cqRing != this->sqRing) munmap(this->cqRing, this->cqRingSize);
+    if (this->sqRing != MAP_FAILED) munmap(this->sqRing, this->sqRingSize);
+}
+
+} // end namespace sg
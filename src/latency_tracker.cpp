@@ -0,0 +1,162 @@
+#include "latency_tracker.hpp"
+#include <bit>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+namespace sg
+{
+
+// Weight of the newest read in average
+static const double AVERAGE_WEIGHT = 1.0 / 8;
+
+// Drive isn't compared with others until it's read that many times
+static const u64 MIN_READS = 16;
+
+// Drive is hedged when its average is that many times the median of the other drives, and at least HEDGE_MIN_MICROS
+static const double HEDGE_FACTOR = 4;
+static const double HEDGE_MIN_MICROS = 2000;
+
+// Drive is demoted when its average is that many times the median of the other drives, and at least DEMOTE_MIN_MICROS
+static const double DEMOTE_FACTOR = 16;
+static const double DEMOTE_MIN_MICROS = 20000;
+
+// Every that many reads demoted drive is still read (hedged), so its average follows its health
+static const u64 PROBE_INTERVAL = 64;
+
+LatencyTracker::LatencyTracker(u16 maxDemoted)
+{
+    this->maxDemoted = maxDemoted;
+}
+
+void LatencyTracker::record(u16 drivenum, u64 micros)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    DriveLatency& latency = this->driveLatency(drivenum);
+
+    latency.average = latency.reads == 0 ? micros : latency.average + (micros - latency.average) * AVERAGE_WEIGHT;
+    latency.reads++;
+    latency.histogram[std::min<size_t>(std::bit_width(micros), HISTOGRAM_BUCKETS - 1)]++;
+
+    double median = this->othersMedian(drivenum);
+    if (latency.reads < MIN_READS || median == 0)
+    {
+        return;
+    }
+
+    if (!latency.demoted && this->demotedCount < this->maxDemoted &&
+        latency.average > median * DEMOTE_FACTOR && latency.average > DEMOTE_MIN_MICROS)
+    {
+        latency.demoted = true;
+        this->demotedCount++;
+        std::cerr << "Warning: Drive " << drivenum + 1 << " is slow (" << std::fixed << std::setprecision(1)
+                  << latency.average / 1000 << " ms per read, other drives " << median / 1000
+                  << " ms), its data will be reconstructed from the other drives." << std::endl;
+    }
+    else if (latency.demoted && latency.average < median * HEDGE_FACTOR)
+    {
+        latency.demoted = false;
+        this->demotedCount--;
+        std::cerr << "Drive " << drivenum + 1 << " is fast again, it's read again." << std::endl;
+    }
+}
+
+DrivePolicy LatencyTracker::policyFor(u16 drivenum)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    DriveLatency& latency = this->driveLatency(drivenum);
+
+    if (latency.demoted)
+    {
+        return ++latency.skipped % PROBE_INTERVAL == 0 ? DrivePolicy::Hedge : DrivePolicy::Reconstruct;
+    }
+
+    double median = this->othersMedian(drivenum);
+    if (latency.reads >= MIN_READS && median > 0 &&
+        latency.average > median * HEDGE_FACTOR && latency.average > HEDGE_MIN_MICROS)
+    {
+        return DrivePolicy::Hedge;
+    }
+
+    return DrivePolicy::Read;
+}
+
+bool LatencyTracker::isDemoted(u16 drivenum)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->driveLatency(drivenum).demoted;
+}
+
+u64 LatencyTracker::hedgeDeadline(u16 drivenum)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    // Healthy drive would be done by then, reconstruction takes about as long as reading them
+    return std::max(this->othersMedian(drivenum) * HEDGE_FACTOR, HEDGE_MIN_MICROS);
+}
+
+void LatencyTracker::printStats(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    out << "Drive latency:" << std::endl;
+
+    for (size_t i = 0; i < this->drives.size(); i++)
+    {
+        auto& latency = this->drives[i];
+        if (latency.reads == 0)
+        {
+            continue;
+        }
+
+        out << "  drive " << i + 1 << ": " << latency.reads << " reads, average "
+            << std::fixed << std::setprecision(1) << latency.average / 1000 << " ms, "
+            << "99% under " << this->percentile(latency, 0.99) / 1000.0 << " ms"
+            << (latency.demoted ? ", demoted" : "") << std::endl;
+    }
+}
+
+LatencyTracker::DriveLatency& LatencyTracker::driveLatency(u16 drivenum)
+{
+    if (this->drives.size() <= drivenum)
+    {
+        this->drives.resize(drivenum + 1);
+    }
+    return this->drives[drivenum];
+}
+
+double LatencyTracker::othersMedian(u16 drivenum)
+{
+    std::vector<double> averages;
+    for (size_t i = 0; i < this->drives.size(); i++)
+    {
+        if (i != drivenum && this->drives[i].reads >= MIN_READS && !this->drives[i].demoted)
+        {
+            averages.push_back(this->drives[i].average);
+        }
+    }
+
+    if (averages.empty())
+    {
+        return 0;
+    }
+
+    std::nth_element(averages.begin(), averages.begin() + averages.size() / 2, averages.end());
+    return averages[averages.size() / 2];
+}
+
+u64 LatencyTracker::percentile(const DriveLatency& latency, double fraction)
+{
+    // Upper bound of the bucket in which fraction of reads is reached
+    u64 seen = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += latency.histogram[bucket];
+        if (seen >= latency.reads * fraction)
+        {
+            return u64(1) << bucket;
+        }
+    }
+    return u64(1) << (HISTOGRAM_BUCKETS - 1);
+}
+
+} // end namespace sg
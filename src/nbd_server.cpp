@@ -0,0 +1,700 @@
+#include "nbd_server.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <signal.h>
+#include <endian.h>
+#include <errno.h>
+#include <string.h>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace sg
+{
+
+// Protocol constants, see https://github.com/NetworkBlockDevice/nbd/blob/master/doc/proto.md
+static const u64 NBD_MAGIC = 0x4e42444d41474943; // "NBDMAGIC"
+static const u64 NBD_IHAVEOPT = 0x49484156454f5054; // "IHAVEOPT"
+static const u64 NBD_REP_MAGIC = 0x0003e889045565a9;
+static const u32 NBD_REQUEST_MAGIC = 0x25609513;
+static const u32 NBD_SIMPLE_REPLY_MAGIC = 0x67446698;
+static const u32 NBD_STRUCTURED_REPLY_MAGIC = 0x668e33ef;
+
+static const u16 NBD_FLAG_FIXED_NEWSTYLE = 1 << 0;
+static const u16 NBD_FLAG_NO_ZEROES = 1 << 1;
+static const u32 NBD_FLAG_C_FIXED_NEWSTYLE = 1 << 0;
+static const u32 NBD_FLAG_C_NO_ZEROES = 1 << 1;
+
+static const u16 NBD_FLAG_HAS_FLAGS = 1 << 0;
+static const u16 NBD_FLAG_READ_ONLY = 1 << 1;
+static const u16 NBD_FLAG_SEND_FLUSH = 1 << 2;
+static const u16 NBD_FLAG_SEND_DF = 1 << 7;
+static const u16 NBD_FLAG_CAN_MULTI_CONN = 1 << 8;
+static const u16 NBD_FLAG_SEND_CACHE = 1 << 10;
+
+static const u32 NBD_OPT_EXPORT_NAME = 1;
+static const u32 NBD_OPT_ABORT = 2;
+static const u32 NBD_OPT_LIST = 3;
+static const u32 NBD_OPT_INFO = 6;
+static const u32 NBD_OPT_GO = 7;
+static const u32 NBD_OPT_STRUCTURED_REPLY = 8;
+static const u32 NBD_OPT_LIST_META_CONTEXT = 9;
+static const u32 NBD_OPT_SET_META_CONTEXT = 10;
+
+static const u32 NBD_REP_ACK = 1;
+static const u32 NBD_REP_SERVER = 2;
+static const u32 NBD_REP_INFO = 3;
+static const u32 NBD_REP_META_CONTEXT = 4;
+static const u32 NBD_REP_ERR_UNSUP = 0x80000001;
+static const u32 NBD_REP_ERR_INVALID = 0x80000003;
+
+static const u16 NBD_INFO_EXPORT = 0;
+static const u16 NBD_INFO_BLOCK_SIZE = 3;
+
+static const u16 NBD_CMD_READ = 0;
+static const u16 NBD_CMD_WRITE = 1;
+static const u16 NBD_CMD_DISC = 2;
+static const u16 NBD_CMD_FLUSH = 3;
+static const u16 NBD_CMD_CACHE = 5;
+static const u16 NBD_CMD_BLOCK_STATUS = 7;
+
+static const u16 NBD_REPLY_FLAG_DONE = 1 << 0;
+static const u16 NBD_REPLY_TYPE_NONE = 0;
+static const u16 NBD_REPLY_TYPE_OFFSET_DATA = 1;
+static const u16 NBD_REPLY_TYPE_BLOCK_STATUS = 5;
+static const u16 NBD_REPLY_TYPE_ERROR = (1 << 15) + 1;
+
+static const u32 NBD_EPERM = 1;
+static const u32 NBD_EIO = 5;
+static const u32 NBD_EINVAL = 22;
+
+static const std::string BASE_ALLOCATION = "base:allocation";
+static const u32 BASE_ALLOCATION_ID = 1;
+
+// Option data is small, anything bigger is not a valid client
+static const u32 MAX_OPTION_LENGTH = 64 * 1024;
+
+/// @brief Big endian serialization of protocol messages.
+class Message
+{
+public:
+    Message& u16be(u16 value) { value = htobe16(value); return this->bytes(&value, sizeof(value)); }
+    Message& u32be(u32 value) { value = htobe32(value); return this->bytes(&value, sizeof(value)); }
+    Message& u64be(u64 value) { value = htobe64(value); return this->bytes(&value, sizeof(value)); }
+    Message& bytes(const void* data, size_t len)
+    {
+        size_t at = this->data.size();
+        this->data.resize(at + len);
+        memcpy(this->data.data() + at, data, len);
+        return *this;
+    }
+
+    std::vector<u8> data;
+};
+
+/// @brief Client has closed connection, it's not an error worth reporting.
+class ClientDisconnected : public std::runtime_error
+{
+public:
+    ClientDisconnected() : std::runtime_error("Client has disconnected.") {}
+};
+
+/// @brief One client, from handshake to disconnect. Protocol errors throw std::runtime_error.
+class NbdClient
+{
+public:
+    NbdClient(int fd, DriveReader& reader, const NbdServerOptions& options)
+        : fd(fd), reader(reader), options(options)
+    {
+        this->size = reader.driveSize();
+    }
+
+    void serve()
+    {
+        if (this->negotiate())
+        {
+            this->transmit();
+        }
+    }
+
+private:
+    int fd;
+    DriveReader& reader;
+    const NbdServerOptions& options;
+    u64 size;
+    bool structuredReplies = false;
+    bool baseAllocation = false;
+    std::vector<u8> buffer;
+
+    void receive(void* buf, size_t len)
+    {
+        u8* ptr = static_cast<u8*>(buf);
+        while (len > 0)
+        {
+            ssize_t rc = ::read(this->fd, ptr, len);
+            if (rc < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (rc == 0)
+            {
+                throw ClientDisconnected();
+            }
+            if (rc < 0)
+            {
+                throw std::runtime_error(std::string("Reading from client has failed. Reason: ") + strerror(errno));
+            }
+            ptr += rc;
+            len -= rc;
+        }
+    }
+
+    u16 receiveU16() { u16 value; this->receive(&value, sizeof(value)); return be16toh(value); }
+    u32 receiveU32() { u32 value; this->receive(&value, sizeof(value)); return be32toh(value); }
+    u64 receiveU64() { u64 value; this->receive(&value, sizeof(value)); return be64toh(value); }
+
+    /// @brief Sends header and payload at once, MSG_NOSIGNAL keeps gone client from killing us with SIGPIPE.
+    void send(const Message& header, const void* payload = nullptr, size_t payloadLen = 0)
+    {
+        iovec iov[2] = {
+            { const_cast<u8*>(header.data.data()), header.data.size() },
+            { const_cast<void*>(payload), payloadLen }
+        };
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = payloadLen > 0 ? 2 : 1;
+
+        while (msg.msg_iovlen > 0)
+        {
+            ssize_t rc = sendmsg(this->fd, &msg, MSG_NOSIGNAL);
+            if (rc < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (rc < 0)
+            {
+                throw std::runtime_error(std::string("Writing to client has failed. Reason: ") + strerror(errno));
+            }
+
+            size_t sent = rc;
+            while (msg.msg_iovlen > 0 && sent >= msg.msg_iov->iov_len)
+            {
+                sent -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+            if (msg.msg_iovlen > 0)
+            {
+                msg.msg_iov->iov_base = static_cast<u8*>(msg.msg_iov->iov_base) + sent;
+                msg.msg_iov->iov_len -= sent;
+            }
+        }
+    }
+
+    u16 transmissionFlags()
+    {
+        u16 flags = NBD_FLAG_HAS_FLAGS | NBD_FLAG_READ_ONLY | NBD_FLAG_SEND_FLUSH | NBD_FLAG_CAN_MULTI_CONN | NBD_FLAG_SEND_CACHE;
+        if (this->structuredReplies)
+        {
+            // Reads are always replied with one chunk
+            flags |= NBD_FLAG_SEND_DF;
+        }
+        return flags;
+    }
+
+    void optionReply(u32 option, u32 type, const Message& data = Message())
+    {
+        Message reply;
+        reply.u64be(NBD_REP_MAGIC).u32be(option).u32be(type).u32be(data.data.size());
+        reply.bytes(data.data.data(), data.data.size());
+        this->send(reply);
+    }
+
+    /// @brief Handshake and option haggling, returns true when client enters transmission phase.
+    bool negotiate()
+    {
+        Message greeting;
+        greeting.u64be(NBD_MAGIC).u64be(NBD_IHAVEOPT).u16be(NBD_FLAG_FIXED_NEWSTYLE | NBD_FLAG_NO_ZEROES);
+        this->send(greeting);
+
+        u32 clientFlags = this->receiveU32();
+        if (clientFlags & ~(NBD_FLAG_C_FIXED_NEWSTYLE | NBD_FLAG_C_NO_ZEROES))
+        {
+            throw std::runtime_error("Client has sent unknown handshake flags.");
+        }
+        bool noZeroes = clientFlags & NBD_FLAG_C_NO_ZEROES;
+
+        while (true)
+        {
+            if (this->receiveU64() != NBD_IHAVEOPT)
+            {
+                throw std::runtime_error("Client has sent invalid option magic.");
+            }
+            u32 option = this->receiveU32();
+            u32 length = this->receiveU32();
+            if (length > MAX_OPTION_LENGTH)
+            {
+                throw std::runtime_error("Client has sent too long option.");
+            }
+            std::vector<u8> data(length);
+            this->receive(data.data(), length);
+
+            switch (option)
+            {
+            case NBD_OPT_EXPORT_NAME:
+            {
+                // Old way to finish negotiation, there is no way to reply with an error
+                Message reply;
+                reply.u64be(this->size).u16be(this->transmissionFlags());
+                if (!noZeroes)
+                {
+                    u8 zeroes[124] = {};
+                    reply.bytes(zeroes, sizeof(zeroes));
+                }
+                this->send(reply);
+                return true;
+            }
+            case NBD_OPT_ABORT:
+                this->optionReply(option, NBD_REP_ACK);
+                return false;
+            case NBD_OPT_LIST:
+                if (length != 0)
+                {
+                    this->optionReply(option, NBD_REP_ERR_INVALID);
+                    break;
+                }
+                this->optionReply(option, NBD_REP_SERVER, Message().u32be(this->options.exportName.size())
+                                                                  .bytes(this->options.exportName.data(), this->options.exportName.size()));
+                this->optionReply(option, NBD_REP_ACK);
+                break;
+            case NBD_OPT_INFO:
+            case NBD_OPT_GO:
+                if (this->exportInfo(option, data) && option == NBD_OPT_GO)
+                {
+                    return true;
+                }
+                break;
+            case NBD_OPT_STRUCTURED_REPLY:
+                if (length != 0)
+                {
+                    this->optionReply(option, NBD_REP_ERR_INVALID);
+                    break;
+                }
+                this->structuredReplies = true;
+                this->optionReply(option, NBD_REP_ACK);
+                break;
+            case NBD_OPT_LIST_META_CONTEXT:
+            case NBD_OPT_SET_META_CONTEXT:
+                this->metaContext(option, data);
+                break;
+            default:
+                this->optionReply(option, NBD_REP_ERR_UNSUP);
+                break;
+            }
+        }
+    }
+
+    /// @brief Replies to NBD_OPT_INFO and NBD_OPT_GO, returns false if option was invalid.
+    bool exportInfo(u32 option, const std::vector<u8>& data)
+    {
+        // u32 name length, name, u16 number of info requests, u16 info requests
+        if (data.size() < 6)
+        {
+            this->optionReply(option, NBD_REP_ERR_INVALID);
+            return false;
+        }
+        u32 nameLength = be32toh(*reinterpret_cast<const u32*>(data.data()));
+        if (data.size() < 6ull + nameLength)
+        {
+            this->optionReply(option, NBD_REP_ERR_INVALID);
+            return false;
+        }
+        u16 requests = be16toh(*reinterpret_cast<const u16*>(data.data() + 4 + nameLength));
+        if (data.size() != 6ull + nameLength + 2ull * requests)
+        {
+            this->optionReply(option, NBD_REP_ERR_INVALID);
+            return false;
+        }
+
+        bool blockSize = false;
+        for (u16 i = 0; i < requests; i++)
+        {
+            u16 request = be16toh(*reinterpret_cast<const u16*>(data.data() + 6 + nameLength + 2 * i));
+            blockSize = blockSize || request == NBD_INFO_BLOCK_SIZE;
+        }
+
+        // There is only one export, so every name means it
+        this->optionReply(option, NBD_REP_INFO, Message().u16be(NBD_INFO_EXPORT).u64be(this->size).u16be(this->transmissionFlags()));
+        if (blockSize)
+        {
+            this->optionReply(option, NBD_REP_INFO, Message().u16be(NBD_INFO_BLOCK_SIZE).u32be(1).u32be(4096).u32be(this->options.maxRequestSize));
+        }
+        this->optionReply(option, NBD_REP_ACK);
+        return true;
+    }
+
+    /// @brief Replies to NBD_OPT_LIST_META_CONTEXT and NBD_OPT_SET_META_CONTEXT, only base:allocation is known.
+    void metaContext(u32 option, const std::vector<u8>& data)
+    {
+        bool set = option == NBD_OPT_SET_META_CONTEXT;
+        if (set && !this->structuredReplies)
+        {
+            this->optionReply(option, NBD_REP_ERR_INVALID);
+            return;
+        }
+
+        // u32 export name length, name, u32 number of queries, queries as u32 length and string
+        size_t pos = 0;
+        auto readU32 = [&](u32& out) {
+            if (pos + 4 > data.size())
+            {
+                return false;
+            }
+            out = be32toh(*reinterpret_cast<const u32*>(data.data() + pos));
+            pos += 4;
+            return true;
+        };
+
+        u32 nameLength, queryCount;
+        std::vector<std::string> queries;
+        bool valid = readU32(nameLength) && (pos += nameLength) <= data.size() && readU32(queryCount);
+        for (u32 i = 0; valid && i < queryCount; i++)
+        {
+            u32 queryLength;
+            valid = readU32(queryLength) && pos + queryLength <= data.size();
+            if (valid)
+            {
+                queries.emplace_back(reinterpret_cast<const char*>(data.data() + pos), queryLength);
+                pos += queryLength;
+            }
+        }
+        if (!valid || pos != data.size())
+        {
+            this->optionReply(option, NBD_REP_ERR_INVALID);
+            return;
+        }
+
+        bool matched = false;
+        if (!set && queries.empty())
+        {
+            matched = true;
+        }
+        for (auto& query : queries)
+        {
+            matched = matched || query == BASE_ALLOCATION || (!set && query == "base:");
+        }
+
+        if (set)
+        {
+            this->baseAllocation = matched;
+        }
+        if (matched)
+        {
+            this->optionReply(option, NBD_REP_META_CONTEXT, Message().u32be(BASE_ALLOCATION_ID).bytes(BASE_ALLOCATION.data(), BASE_ALLOCATION.size()));
+        }
+        this->optionReply(option, NBD_REP_ACK);
+    }
+
+    void reply(u64 cookie, u32 error)
+    {
+        Message header;
+        if (!this->structuredReplies)
+        {
+            header.u32be(NBD_SIMPLE_REPLY_MAGIC).u32be(error).u64be(cookie);
+        }
+        else if (error != 0)
+        {
+            // Error code and empty message
+            header.u32be(NBD_STRUCTURED_REPLY_MAGIC).u16be(NBD_REPLY_FLAG_DONE).u16be(NBD_REPLY_TYPE_ERROR).u64be(cookie).u32be(6);
+            header.u32be(error).u16be(0);
+        }
+        else
+        {
+            header.u32be(NBD_STRUCTURED_REPLY_MAGIC).u16be(NBD_REPLY_FLAG_DONE).u16be(NBD_REPLY_TYPE_NONE).u64be(cookie).u32be(0);
+        }
+        this->send(header);
+    }
+
+    void replyData(u64 cookie, u64 offset, const void* data, u32 len)
+    {
+        Message header;
+        if (this->structuredReplies)
+        {
+            header.u32be(NBD_STRUCTURED_REPLY_MAGIC).u16be(NBD_REPLY_FLAG_DONE).u16be(NBD_REPLY_TYPE_OFFSET_DATA).u64be(cookie).u32be(8 + len);
+            header.u64be(offset);
+        }
+        else
+        {
+            header.u32be(NBD_SIMPLE_REPLY_MAGIC).u32be(0).u64be(cookie);
+        }
+        this->send(header, data, len);
+    }
+
+    /// @brief Reads range of the array into buffer, returns NBD error code.
+    u32 readRange(u32 len, u64 offset)
+    {
+        if (len == 0 || len > this->options.maxRequestSize || offset > this->size || len > this->size - offset)
+        {
+            return NBD_EINVAL;
+        }
+
+        if (this->buffer.size() < len)
+        {
+            this->buffer.resize(len);
+        }
+
+        try
+        {
+            this->reader.read(this->buffer.data(), len, offset);
+        }
+        catch (std::runtime_error& ex)
+        {
+            std::cerr << "Runtime error occured while reading data: " << ex.what() << std::endl;
+            return NBD_EIO;
+        }
+        return 0;
+    }
+
+    void transmit()
+    {
+        while (true)
+        {
+            if (this->receiveU32() != NBD_REQUEST_MAGIC)
+            {
+                throw std::runtime_error("Client has sent invalid request magic.");
+            }
+            this->receiveU16(); // command flags, every reply is one chunk anyway
+            u16 type = this->receiveU16();
+            u64 cookie = this->receiveU64();
+            u64 offset = this->receiveU64();
+            u32 len = this->receiveU32();
+
+            switch (type)
+            {
+            case NBD_CMD_READ:
+            {
+                u32 error = this->readRange(len, offset);
+                if (error != 0)
+                {
+                    this->reply(cookie, error);
+                    break;
+                }
+                this->replyData(cookie, offset, this->buffer.data(), len);
+                break;
+            }
+            case NBD_CMD_CACHE:
+                // Data is read and thrown away, so following reads hit page cache
+                this->reply(cookie, this->readRange(len, offset));
+                break;
+            case NBD_CMD_BLOCK_STATUS:
+                if (!this->baseAllocation || len == 0 || offset > this->size || len > this->size - offset)
+                {
+                    this->reply(cookie, NBD_EINVAL);
+                }
+                else
+                {
+                    // Every block of the array is allocated data, so one extent covers whole range
+                    Message header;
+                    header.u32be(NBD_STRUCTURED_REPLY_MAGIC).u16be(NBD_REPLY_FLAG_DONE).u16be(NBD_REPLY_TYPE_BLOCK_STATUS).u64be(cookie).u32be(12);
+                    header.u32be(BASE_ALLOCATION_ID).u32be(len).u32be(0);
+                    this->send(header);
+                }
+                break;
+            case NBD_CMD_FLUSH:
+                this->reply(cookie, 0);
+                break;
+            case NBD_CMD_DISC:
+                return;
+            case NBD_CMD_WRITE:
+                // Payload has to be consumed before the error
+                while (len > 0)
+                {
+                    u8 discard[4096];
+                    u32 chunk = std::min<u32>(len, sizeof(discard));
+                    this->receive(discard, chunk);
+                    len -= chunk;
+                }
+                this->reply(cookie, NBD_EPERM);
+                break;
+            default:
+                // Trim and write zeroes aren't advertised, array is read only
+                this->reply(cookie, NBD_EINVAL);
+                break;
+            }
+        }
+    }
+};
+
+NbdServer::NbdServer(DriveReader& reader, const NbdServerOptions& options)
+    : reader(reader), options(options)
+{
+}
+
+NbdServer::~NbdServer()
+{
+    if (this->listenFd >= 0)
+    {
+        close(this->listenFd);
+    }
+    if (!this->unixPath.empty())
+    {
+        unlink(this->unixPath.c_str());
+    }
+}
+
+void NbdServer::listenUnix(const std::string& path)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        throw std::invalid_argument("Socket path " + path + " is too long.");
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    // Socket left by previous run, other files are not ours to remove
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path.c_str());
+    }
+
+    this->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->listenFd < 0 || bind(this->listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(this->listenFd, SOMAXCONN) < 0)
+    {
+        throw std::runtime_error("Listening on " + path + " has failed. Reason: " + strerror(errno));
+    }
+    this->unixPath = path;
+}
+
+void NbdServer::listenTcp(const std::string& address, u16 port)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo* addresses;
+    std::string portStr = std::to_string(port);
+    int rc = getaddrinfo(address.empty() ? nullptr : address.c_str(), portStr.c_str(), &hints, &addresses);
+    if (rc != 0)
+    {
+        throw std::runtime_error("Resolving " + address + " has failed. Reason: " + gai_strerror(rc));
+    }
+
+    int error = 0;
+    for (addrinfo* ai = addresses; ai != nullptr; ai = ai->ai_next)
+    {
+        int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+        {
+            error = errno;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+        {
+            this->listenFd = fd;
+            break;
+        }
+        error = errno;
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+
+    if (this->listenFd < 0)
+    {
+        throw std::runtime_error("Listening on " + address + ":" + portStr + " has failed. Reason: " + strerror(error));
+    }
+}
+
+void NbdServer::run()
+{
+    sigset_t signals, oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    // Client threads inherit the mask, so signals go only to us
+    pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+
+    std::thread acceptThread(&NbdServer::acceptLoop, this);
+
+    int signal;
+    sigwait(&signals, &signal);
+
+    // Wakes accept and reads of clients, their threads finish on their own
+    shutdown(this->listenFd, SHUT_RDWR);
+    acceptThread.join();
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (int fd : this->clients)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+        this->clientsDone.wait(lock, [this]() { return this->clients.empty(); });
+    }
+
+    pthread_sigmask(SIG_SETMASK, &oldSignals, nullptr);
+}
+
+void NbdServer::acceptLoop()
+{
+    while (true)
+    {
+        int fd = accept4(this->listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0 && (errno == EINTR || errno == ECONNABORTED))
+        {
+            continue;
+        }
+        if (fd < 0)
+        {
+            // Listening socket was shut down
+            return;
+        }
+
+        // Replies are written in one go, no need to wait for more data (fails harmlessly on unix sockets)
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->clients.insert(fd);
+        std::thread(&NbdServer::serveClient, this, fd).detach();
+    }
+}
+
+void NbdServer::serveClient(int fd)
+{
+    try
+    {
+        NbdClient client(fd, this->reader, this->options);
+        client.serve();
+    }
+    catch (ClientDisconnected&)
+    {
+    }
+    catch (std::runtime_error& ex)
+    {
+        std::cerr << "Client error: " << ex.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    close(fd);
+    this->clients.erase(fd);
+    this->clientsDone.notify_all();
+}
+
+} // end namespace sg
@@ -0,0 +1,160 @@
+#include "parity_scrubber.hpp"
+#include "progress_monitor.hpp"
+#include <thread>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace sg
+{
+
+ParityScrubber::ParityScrubber(SmartArrayReaderBase& array, const ParityScrubberOptions& options)
+    : array(array), options(options)
+{
+    if (options.threads == 0 || options.rowsPerTask == 0)
+    {
+        throw std::invalid_argument("At least one thread and one row per task are needed to verify the array.");
+    }
+
+    this->rows = array.stripeRows();
+}
+
+bool ParityScrubber::run()
+{
+    // Started before workers, so they inherit its signal mask
+    ProgressMonitor progress(this->rows, 0, this->array.rowSize(), [](u64 done, u64 total) {
+        return std::to_string(done) + " / " + std::to_string(total) + " rows";
+    });
+
+    this->workerBadRows.resize(this->options.threads);
+    this->workersRunning = this->options.threads;
+    std::vector<std::thread> workers;
+    for (u32 i = 0; i < this->options.threads; i++)
+    {
+        workers.emplace_back(&ParityScrubber::verifyLoop, this, std::ref(this->workerBadRows[i]));
+    }
+
+    bool interrupted = false;
+    while (true)
+    {
+        u64 verified;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            progress.wait(this->workerDone, lock, [this]() {
+                return this->workersRunning == 0;
+            });
+            if (this->workersRunning == 0)
+            {
+                break;
+            }
+            verified = this->rowsVerified;
+        }
+
+        if (progress.interrupted())
+        {
+            interrupted = true;
+            break;
+        }
+        progress.update(verified);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+
+    this->seconds = progress.finish();
+    this->mergeBadRows();
+
+    if (this->error)
+    {
+        std::rethrow_exception(this->error);
+    }
+
+    return !interrupted;
+}
+
+const BadRowList& ParityScrubber::badRows() const
+{
+    return this->mergedBadRows;
+}
+
+void ParityScrubber::printSummary(std::ostream& out)
+{
+    out << "Verified " << this->rowsVerified << " of " << this->rows << " rows in "
+        << std::fixed << std::setprecision(1) << this->seconds << " s";
+    if (this->seconds > 0)
+    {
+        out << " (" << this->rowsVerified * this->array.rowSize() / this->seconds / 1e6 << " MB/s of data)";
+    }
+    out << ", " << this->mergedBadRows.rowCount() << " rows with mismatching parity" << std::endl;
+}
+
+void ParityScrubber::verifyLoop(BadRowList& badRows)
+{
+    while (true)
+    {
+        u64 firstRow;
+        u32 count;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->stopping || this->nextRow == this->rows)
+            {
+                break;
+            }
+            firstRow = this->nextRow;
+            count = std::min<u64>(this->options.rowsPerTask, this->rows - firstRow);
+            this->nextRow += count;
+        }
+
+        try
+        {
+            this->array.verifyRows(firstRow, count, badRows);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (!this->error)
+            {
+                this->error = std::current_exception();
+            }
+            this->stopping = true;
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->rowsVerified += count;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->workersRunning--;
+    }
+    this->workerDone.notify_all();
+}
+
+void ParityScrubber::mergeBadRows()
+{
+    // Every worker has its rows in order, together they have to be sorted
+    std::vector<BadRowRange> ranges;
+    for (auto& list : this->workerBadRows)
+    {
+        ranges.insert(ranges.end(), list.ranges().begin(), list.ranges().end());
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const BadRowRange& a, const BadRowRange& b) {
+        return a.firstRow < b.firstRow;
+    });
+
+    this->mergedBadRows = BadRowList();
+    for (auto& range : ranges)
+    {
+        this->mergedBadRows.add(range);
+    }
+}
+
+} // end namespace sg
@@ -0,0 +1,64 @@
+#include "progress_monitor.hpp"
+#include <iomanip>
+#include <iostream>
+
+namespace sg
+{
+
+ProgressMonitor::ProgressMonitor(u64 total, u64 done, u64 bytesPerUnit, std::function<std::string(u64 done, u64 total)> describe)
+    : total(total), bytesPerUnit(bytesPerUnit), describe(std::move(describe)), lastProgressDone(done)
+{
+    sigemptyset(&this->signals);
+    sigaddset(&this->signals, SIGINT);
+    sigaddset(&this->signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &this->signals, &this->oldMask);
+
+    this->start = std::chrono::steady_clock::now();
+    this->lastProgress = this->start;
+}
+
+ProgressMonitor::~ProgressMonitor()
+{
+    this->finish();
+}
+
+bool ProgressMonitor::interrupted()
+{
+    timespec noWait = {};
+    return sigtimedwait(&this->signals, nullptr, &noWait) > 0;
+}
+
+void ProgressMonitor::update(u64 done)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - this->lastProgress < std::chrono::seconds(1))
+    {
+        return;
+    }
+
+    double elapsed = std::chrono::duration<double>(now - this->lastProgress).count();
+    std::cerr << "\r" << this->describe(done, this->total)
+              << " (" << (this->total > 0 ? done * 100 / this->total : 100) << "%), "
+              << std::fixed << std::setprecision(1) << (done - this->lastProgressDone) * this->bytesPerUnit / elapsed / 1e6 << " MB/s    "
+              << std::flush;
+    this->lastProgress = now;
+    this->lastProgressDone = done;
+    this->progressPrinted = true;
+}
+
+double ProgressMonitor::finish()
+{
+    if (!this->finished)
+    {
+        this->finished = true;
+        pthread_sigmask(SIG_SETMASK, &this->oldMask, nullptr);
+        if (this->progressPrinted)
+        {
+            std::cerr << std::endl;
+        }
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - this->start).count();
+}
+
+} // end namespace sg
@@ -0,0 +1,59 @@
+#include "read_planner.hpp"
+#include <algorithm>
+#include <limits.h>
+
+namespace sg
+{
+
+void ReadPlanner::add(DriveReader* drive, void* buf, u32 len, u64 offset)
+{
+    this->segments.push_back({ drive, buf, len, offset });
+}
+
+std::vector<ReadRequest>& ReadPlanner::plan()
+{
+    // Stable sort keeps segments of every drive in order of offsets
+    std::stable_sort(this->segments.begin(), this->segments.end(), [](const ReadRequest& a, const ReadRequest& b) {
+        return a.drive < b.drive;
+    });
+
+    this->requests.clear();
+    this->iovecs.clear();
+    // iovecs can't be reallocated, requests point into it
+    this->iovecs.reserve(this->segments.size());
+
+    size_t i = 0;
+    while (i < this->segments.size())
+    {
+        // Find how many following segments continue on the same drive
+        size_t end = i + 1;
+        u64 nextOffset = this->segments[i].offset + this->segments[i].len;
+        while (end < this->segments.size() && end - i < IOV_MAX &&
+               this->segments[end].drive == this->segments[i].drive &&
+               this->segments[end].offset == nextOffset)
+        {
+            nextOffset += this->segments[end].len;
+            end++;
+        }
+
+        ReadRequest request = this->segments[i];
+        if (end - i > 1)
+        {
+            request.iov = this->iovecs.data() + this->iovecs.size();
+            request.iovcnt = end - i;
+            request.len = nextOffset - request.offset;
+
+            for (size_t j = i; j < end; j++)
+            {
+                this->iovecs.push_back({ this->segments[j].buf, this->segments[j].len });
+            }
+        }
+
+        this->requests.push_back(request);
+        i = end;
+    }
+
+    return this->requests;
+}
+
+} // end namespace sg
@@ -0,0 +1,264 @@
+#include "readahead.hpp"
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace sg
+{
+
+// Every row is read from all drives at once already, so few threads are enough to keep them busy
+static const u32 MAX_READAHEAD_THREADS = 4;
+
+Readahead::Readahead(ReadFunction read, u64 rowSize, u32 depth, u64 driveSize)
+    : bufferPool(rowSize, 4096)
+{
+    this->readFunction = read;
+    this->rowSize = rowSize;
+    this->depth = depth;
+    this->size = driveSize;
+    this->pool = std::make_unique<ThreadPool>(std::min(depth, MAX_READAHEAD_THREADS));
+}
+
+Readahead::~Readahead()
+{
+    this->stop();
+}
+
+void Readahead::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->pool.reset();
+}
+
+void Readahead::read(void* buf, u32 len, u64 offset)
+{
+    if (len == 0)
+    {
+        return;
+    }
+
+    char* out = static_cast<char*>(buf);
+    u64 end = offset + len;
+    u64 firstRow = offset / this->rowSize;
+    u64 lastRow = (end - 1) / this->rowSize;
+
+    std::vector<std::shared_ptr<Row>> present(lastRow - firstRow + 1);
+    std::vector<std::pair<u64, std::shared_ptr<Row>>> toPrefetch;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (u64 row = firstRow; row <= lastRow; row++)
+        {
+            auto it = this->rows.find(row);
+            if (it != this->rows.end())
+            {
+                present[row - firstRow] = it->second;
+            }
+        }
+
+        for (u64 row : this->trackStream(len, offset))
+        {
+            // Rows already consumed by their stream are forgotten
+            while (!this->rowOrder.empty() && !this->rows.contains(this->rowOrder.front()))
+            {
+                this->rowOrder.pop_front();
+            }
+
+            // Oldest rows make room for new ones, readers still using them keep their buffers alive
+            while (this->rows.size() >= static_cast<size_t>(this->depth) * MAX_STREAMS && !this->rowOrder.empty())
+            {
+                u64 oldest = this->rowOrder.front();
+                this->rowOrder.pop_front();
+                auto it = this->rows.find(oldest);
+                if (it != this->rows.end())
+                {
+                    this->dropRow(oldest, it->second);
+                }
+            }
+
+            auto data = std::make_shared<Row>(this->bufferPool, this->rowLength(row));
+            this->rows[row] = data;
+            this->rowOrder.push_back(row);
+            toPrefetch.emplace_back(row, data);
+        }
+    }
+
+    for (auto& [row, data] : toPrefetch)
+    {
+        this->pool->post([this, row, data]() { this->prefetch(row, data); });
+    }
+
+    u64 pos = offset;
+    while (pos < end)
+    {
+        u64 row = pos / this->rowSize;
+        u64 rowStart = row * this->rowSize;
+        u64 chunkEnd = std::min(end, rowStart + this->rowSize);
+        auto& data = present[row - firstRow];
+
+        if (data)
+        {
+            RowState state;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->rowLoaded.wait(lock, [&data]() { return data->state != RowState::Loading; });
+                state = data->state;
+                data->used = true;
+            }
+
+            if (state == RowState::Ready)
+            {
+                memcpy(out + (pos - offset), data->buffer.data() + (pos - rowStart), chunkEnd - pos);
+                this->hits++;
+
+                // Stream has passed the row, it won't be needed again
+                if (chunkEnd == rowStart + data->len)
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->dropRow(row, data);
+                }
+                pos = chunkEnd;
+                continue;
+            }
+        }
+
+        // Rows without prefetched data next to each other are read at once
+        u64 directEnd = chunkEnd;
+        while (directEnd < end && !present[directEnd / this->rowSize - firstRow])
+        {
+            directEnd = std::min(end, directEnd + this->rowSize);
+        }
+
+        this->readFunction(out + (pos - offset), directEnd - pos, pos);
+        this->misses += (directEnd - 1) / this->rowSize - row + 1;
+        pos = directEnd;
+    }
+}
+
+void Readahead::printStats(std::ostream& out)
+{
+    u64 hits = this->hits;
+    u64 misses = this->misses;
+    u64 total = hits + misses;
+    out << "Readahead: " << hits << " hits, " << misses << " misses";
+    if (total > 0)
+    {
+        out << " (" << hits * 100 / total << "% hit rate)";
+    }
+    out << ", " << this->prefetchedRows << " rows prefetched, " << this->unusedRows << " evicted unused" << std::endl;
+}
+
+std::vector<u64> Readahead::trackStream(u32 len, u64 offset)
+{
+    u64 end = offset + len;
+
+    // Requests of one stream can come slightly out of order from many nbd threads
+    Stream* stream = nullptr;
+    for (auto& candidate : this->streams)
+    {
+        if (offset <= candidate.nextOffset + this->rowSize && candidate.nextOffset <= offset + this->rowSize)
+        {
+            stream = &candidate;
+            break;
+        }
+    }
+
+    if (stream != nullptr)
+    {
+        stream->sequentialReads++;
+        stream->nextOffset = std::max(stream->nextOffset, end);
+    }
+    else
+    {
+        if (this->streams.size() < MAX_STREAMS)
+        {
+            this->streams.emplace_back();
+            stream = &this->streams.back();
+        }
+        else
+        {
+            stream = &*std::min_element(this->streams.begin(), this->streams.end(),
+                                        [](const Stream& a, const Stream& b) { return a.lastUse < b.lastUse; });
+        }
+        *stream = { end, 0, 0, 0 };
+    }
+    stream->lastUse = ++this->useCounter;
+
+    std::vector<u64> toPrefetch;
+    if (this->stopping || stream->sequentialReads < SEQUENTIAL_THRESHOLD)
+    {
+        return toPrefetch;
+    }
+
+    u64 rowCount = (this->size + this->rowSize - 1) / this->rowSize;
+    u64 nextRow = stream->nextOffset / this->rowSize;
+    u64 until = std::min(nextRow + this->depth, rowCount);
+    for (u64 row = std::max(nextRow, stream->prefetchedUntil); row < until; row++)
+    {
+        if (!this->rows.contains(row))
+        {
+            toPrefetch.push_back(row);
+        }
+    }
+    stream->prefetchedUntil = std::max(stream->prefetchedUntil, until);
+
+    return toPrefetch;
+}
+
+void Readahead::prefetch(u64 row, std::shared_ptr<Row> data)
+{
+    bool skip;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        skip = this->stopping;
+    }
+
+    RowState state = RowState::Failed;
+    if (!skip)
+    {
+        try
+        {
+            this->readFunction(data->buffer.data(), data->len, row * this->rowSize);
+            state = RowState::Ready;
+            this->prefetchedRows++;
+        }
+        catch (std::exception&)
+        {
+            // Row will be read again when it's requested, then the error is reported
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        data->state = state;
+        if (state == RowState::Failed)
+        {
+            this->dropRow(row, data);
+        }
+    }
+    this->rowLoaded.notify_all();
+}
+
+void Readahead::dropRow(u64 row, const std::shared_ptr<Row>& data)
+{
+    auto it = this->rows.find(row);
+    if (it == this->rows.end() || it->second != data)
+    {
+        return;
+    }
+
+    if (!data->used && data->state == RowState::Ready)
+    {
+        this->unusedRows++;
+    }
+    this->rows.erase(it);
+}
+
+u32 Readahead::rowLength(u64 row)
+{
+    return std::min(this->rowSize, this->size - row * this->rowSize);
+}
+
+} // end namespace sg
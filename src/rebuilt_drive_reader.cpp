@@ -0,0 +1,110 @@
+#include "rebuilt_drive_reader.hpp"
+#include "metadata_parser.hpp"
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+
+namespace sg
+{
+
+// Size of metadata parsed by parseMetadata, after it the same metadata is repeated
+static const u64 METADATA_COPY_SIZE = 0x28000;
+
+RebuiltDriveReader::RebuiltDriveReader(std::shared_ptr<SmartArrayReaderBase> array, u16 drivenum,
+                                       std::shared_ptr<DriveReader> metadataSource, u16 metadataSourceNum, u64 size)
+{
+    this->array = array;
+    this->drivenum = drivenum;
+    this->size = std::max(size, array->memberDataSize() + MEMBER_METADATA_AREA_SIZE);
+    this->driveName = "rebuilt drive " + std::to_string(drivenum);
+
+    // Empty metadata area makes controller see it as a new drive
+    this->metadataArea.resize(MEMBER_METADATA_AREA_SIZE);
+    if (!metadataSource)
+    {
+        return;
+    }
+
+    // Metadata is at the end of every drive, even if drives have different sizes
+    metadataSource->read(this->metadataArea.data(), MEMBER_METADATA_AREA_SIZE,
+                         metadataSource->driveSize() - MEMBER_METADATA_AREA_SIZE);
+
+    if (!this->setDriveNumber(metadataSourceNum))
+    {
+        std::cerr << "Warning: Rebuilt drive wasn't found in controller metadata of " << metadataSource->name()
+                  << ", so its metadata area is left empty. Controller will see it as a new drive." << std::endl;
+        std::fill(this->metadataArea.begin(), this->metadataArea.end(), 0);
+    }
+}
+
+int RebuiltDriveReader::read(void* buf, u32 len, u64 offset)
+{
+    if (offset + len > this->size)
+    {
+        std::cerr << this->name() << ": Tried to read from offset exceeding drive size. Skipping." << std::endl;
+        return -1;
+    }
+
+    char* out = static_cast<char*>(buf);
+    u64 dataSize = this->array->memberDataSize();
+    u64 metadataStart = this->size - MEMBER_METADATA_AREA_SIZE;
+
+    if (offset < dataSize)
+    {
+        u32 dataLen = std::min<u64>(len, dataSize - offset);
+        this->array->rebuildMember(out, this->drivenum, dataLen, offset);
+        out += dataLen;
+        offset += dataLen;
+        len -= dataLen;
+    }
+
+    if (len > 0 && offset < metadataStart)
+    {
+        u32 gapLen = std::min<u64>(len, metadataStart - offset);
+        memset(out, 0, gapLen);
+        out += gapLen;
+        offset += gapLen;
+        len -= gapLen;
+    }
+
+    if (len > 0)
+    {
+        memcpy(out, this->metadataArea.data() + (offset - metadataStart), len);
+    }
+
+    return 0;
+}
+
+u64 RebuiltDriveReader::driveSize()
+{
+    return this->size;
+}
+
+bool RebuiltDriveReader::setDriveNumber(u16 metadataSourceNum)
+{
+    u8* metadata = this->metadataArea.data() + (MEMBER_METADATA_AREA_SIZE - MEMBER_METADATA_NEGATIVE_OFFSET);
+    P420Metadata parsed;
+    parseMetadata(metadata, &parsed);
+
+    // Logical drive lists numbers of its member drives in order of the array
+    for (auto& ld : parsed.logicalDrives)
+    {
+        if (ld.physicalDrives.size() <= std::max(this->drivenum, metadataSourceNum) ||
+            ld.physicalDrives[metadataSourceNum] != parsed.driveNumber)
+        {
+            continue;
+        }
+
+        u8 number = ld.physicalDrives[this->drivenum];
+        if (metadata[METADATA_COPY_SIZE] == metadata[0])
+        {
+            metadata[METADATA_COPY_SIZE] = number;
+        }
+        metadata[0] = number;
+        return true;
+    }
+
+    return false;
+}
+
+} // end namespace sg
@@ -0,0 +1,80 @@
+#include "scratch_arena.hpp"
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+
+namespace sg
+{
+
+ScratchArena::Frame::Frame()
+    : arena(ScratchArena::forThisThread())
+{
+    this->block = this->arena.currentBlock;
+    this->used = this->arena.used;
+}
+
+ScratchArena::Frame::~Frame()
+{
+    this->arena.currentBlock = this->block;
+    this->arena.used = this->used;
+}
+
+char* ScratchArena::Frame::allocate(size_t len)
+{
+    return this->arena.allocate(len);
+}
+
+ScratchArena::~ScratchArena()
+{
+    for (auto& block : this->blocks)
+    {
+        free(block.data);
+    }
+}
+
+ScratchArena& ScratchArena::forThisThread()
+{
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+char* ScratchArena::allocate(size_t len)
+{
+    // Every buffer starts aligned, so the next one will be too
+    len = (len + SCRATCH_ALIGNMENT - 1) / SCRATCH_ALIGNMENT * SCRATCH_ALIGNMENT;
+
+    while (this->currentBlock < this->blocks.size())
+    {
+        auto& block = this->blocks[this->currentBlock];
+        if (this->used + len <= block.size)
+        {
+            char* buffer = block.data + this->used;
+            this->used += len;
+            return buffer;
+        }
+
+        if (this->currentBlock + 1 == this->blocks.size())
+        {
+            break;
+        }
+        this->currentBlock++;
+        this->used = 0;
+    }
+
+    Block block;
+    block.size = std::max(len, SCRATCH_BLOCK_SIZE);
+    void* data = nullptr;
+    if (posix_memalign(&data, SCRATCH_ALIGNMENT, block.size) != 0)
+    {
+        throw std::bad_alloc();
+    }
+    block.data = static_cast<char*>(data);
+
+    this->blocks.push_back(block);
+    this->currentBlock = this->blocks.size() - 1;
+    this->used = len;
+
+    return block.data;
+}
+
+} // end namespace sg
@@ -1,4 +1,5 @@
 #include "smart_array_raid_0_reader.hpp"
+#include "thread_pool_drive_reader.hpp"
 #include <math.h>
 #include <memory.h>
 #include <iostream>
@@ -50,9 +51,40 @@ SmartArrayRaid0Reader::SmartArrayRaid0Reader(const SmartArrayRaid0ReaderOptions
     {
         this->setSize(options.size, maximumSize);
     }
+
+    this->geometry = std::make_unique<StripeGeometry>(
+        this->stripeSizeInBytes, this->drives.size(), 0, 1, this->driveSize(), this->getPhysicalDriveOffset());
+
+    if (options.parallelDrives && this->drives.size() > 1)
+    {
+        // Calling thread reads one of the drives itself
+        this->asyncReader = std::make_shared<ThreadPoolDriveReader>(this->drives.size() - 1);
+    }
 }
 
-int SmartArrayRaid0Reader::read(void* buf, u32 len, u64 offset)
+SmartArrayRaid0Reader::~SmartArrayRaid0Reader()
+{
+    this->stopReadahead();
+}
+
+u64 SmartArrayRaid0Reader::rowSize()
+{
+    return this->geometry->logicalRowSize();
+}
+
+void SmartArrayRaid0Reader::printStats(std::ostream& out)
+{
+    SmartArrayReaderBase::printStats(out);
+    for (auto& drive : this->drives)
+    {
+        if (drive)
+        {
+            drive->printStats(out);
+        }
+    }
+}
+
+int SmartArrayRaid0Reader::readArray(void* buf, u32 len, u64 offset)
 {
     if (offset >= this->driveSize())
     {
@@ -60,84 +92,40 @@ int SmartArrayRaid0Reader::read(void* buf, u32 len, u64 offset)
         return -1;
     }
 
-    u64 stripenum = this->stripeNumber(offset);
-    u32 stripeRelativeOffset = this->stripeRelativeOffset(stripenum, offset);  
+    StripeLocation location = this->geometry->locate(offset);
+
+    // Segments from healthy drives are collected here and read all at once,
+    // segments following each other on the same drive are read with one request.
+    ReadPlanner planner;
 
     while (len != 0)
     {
-        u32 read = this->readFromStripe(buf, stripenum, stripeRelativeOffset, len);
+        u32 read = this->readFromStripe(buf, location, len, planner);
         len -= read;
         buf = static_cast<char*>(buf) + read;
 
         if (len > 0)
         {
-            stripenum++;
-            stripeRelativeOffset = 0;
+            this->geometry->next(location);
         }
     }
 
-    return 0;
-}
-
-u64 SmartArrayRaid0Reader::stripeNumber(u64 offset)
-{
-    u64 stripenum = offset / this->stripeSizeInBytes;
-    if (this->isLastRow(stripenum / drives.size()))
-    {
-        u64 o = offset - (stripenum * this->stripeSizeInBytes);
-        u64 lastStripeNum = o / this->lastRowStripeSize();
-        stripenum += lastStripeNum;
-    }
-
-    return stripenum;
-}
+    this->asyncReader->readAll(planner.plan());
 
-u32 SmartArrayRaid0Reader::stripeRelativeOffset(u64 stripenum, u64 offset)
-{
-    u32 o = offset - stripenum * this->stripeSizeInBytes;
-    if (this->isLastRow(stripenum / drives.size()))
-    {
-        o %= this->lastRowStripeSize();
-    }
-    return o;
-}
-
-u16 SmartArrayRaid0Reader::stripeDriveNumber(u64 stripenum)
-{
-    return stripenum % drives.size();
-}
-
-u64 SmartArrayRaid0Reader::stripeDriveOffset(u64 stripenum, u32 stripeRelativeOffset)
-{
-    u64 currentStripeRow = stripenum / drives.size();
-    return (currentStripeRow * this->stripeSizeInBytes) + stripeRelativeOffset + this->getPhysicalDriveOffset();
-}
-
-u32 SmartArrayRaid0Reader::lastRowStripeSize()
-{
-    u32 fullStripeSize = this->stripeSizeInBytes * this->drives.size();
-    u64 wholeStripesOnDrive = this->driveSize() / fullStripeSize;
-    u32 lastFullStripeSize = this->driveSize() - wholeStripesOnDrive * fullStripeSize;
-    return lastFullStripeSize / this->drives.size();
+    return 0;
 }
 
-bool SmartArrayRaid0Reader::isLastRow(u64 rownum)
+bool SmartArrayRaid0Reader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
 {
-    u32 fullStripeSize = this->stripeSizeInBytes * this->drives.size();
-    u64 wholeStripesOnDrive = this->driveSize() / fullStripeSize;
-    return rownum == wholeStripesOnDrive;
+    return this->mapStripes(*this->geometry, this->drives, len, offset, extents);
 }
 
-u32 SmartArrayRaid0Reader::readFromStripe(void *buf, u64 stripenum, u32 stripeRelativeOffset, u32 len)
+u32 SmartArrayRaid0Reader::readFromStripe(void *buf, const StripeLocation& location, u32 len, ReadPlanner& planner)
 {
-    auto drivenum = stripeDriveNumber(stripenum);
-    auto driveOffset = stripeDriveOffset(stripenum, stripeRelativeOffset);
-    auto stripeSize = this->stripeSizeInBytes;
-
-    if (this->isLastRow(stripenum / drives.size()))
-    {
-        stripeSize = this->lastRowStripeSize();
-    }
+    auto drivenum = this->geometry->driveNumber(location);
+    auto driveOffset = this->geometry->driveOffset(location);
+    auto stripeSize = this->geometry->stripeSize(location);
+    auto stripeRelativeOffset = location.relativeOffset;
 
     if ((len + stripeRelativeOffset) > stripeSize)
     {
@@ -149,7 +137,7 @@ u32 SmartArrayRaid0Reader::readFromStripe(void *buf, u64 stripenum, u32 stripeRe
     }
 
     auto& drivePtr = this->drives[drivenum];
-    drivePtr->read(buf, len, driveOffset);
+    planner.add(drivePtr.get(), buf, len, driveOffset);
 
     return len;
 }
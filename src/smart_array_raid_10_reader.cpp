@@ -1,4 +1,5 @@
 #include "smart_array_raid_10_reader.hpp"
+#include <stdexcept>
 #include <vector>
 
 namespace sg
@@ -59,20 +60,42 @@ SmartArrayRaid10Reader::SmartArrayRaid10Reader(const SmartArrayRaid10ReaderOptio
         // "touching" physical drives direcly but rather thru
         // raid 1 readers
         .offset = 0,
-        .nometadata = true
+        .nometadata = true,
+        .parallelDrives = true
     };
 
     this->raid0Reader = std::make_unique<SmartArrayRaid0Reader>(reader0Options);
 }
 
-int SmartArrayRaid10Reader::read(void *buf, u32 len, u64 offset)
+SmartArrayRaid10Reader::~SmartArrayRaid10Reader()
+{
+    this->stopReadahead();
+}
+
+u64 SmartArrayRaid10Reader::rowSize()
+{
+    return this->raid0Reader->rowSize();
+}
+
+int SmartArrayRaid10Reader::readArray(void *buf, u32 len, u64 offset)
 {
     return this->raid0Reader->read(buf, len, offset);
 }
 
+bool SmartArrayRaid10Reader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    return this->raid0Reader->mapExtents(len, offset, extents);
+}
+
 u64 SmartArrayRaid10Reader::driveSize()
 {
     return this->raid0Reader->driveSize();
 }
 
+void SmartArrayRaid10Reader::printStats(std::ostream& out)
+{
+    SmartArrayReaderBase::printStats(out);
+    this->raid0Reader->printStats(out);
+}
+
 } // end namespace sg
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "smart_array_raid_1_reader.hpp"
+#include "thread_pool_drive_reader.hpp"
+#include <stdexcept>
 #include <memory.h>
 #include <algorithm>
 #include <iostream>
@@ -7,6 +9,12 @@
 namespace sg
 {
 
+// Mirror has no stripes, readahead goes by chunks of this size
+static const u64 MIRROR_ROW_SIZE = 1024 * 1024;
+
+// Reads at least this big are split between mirrors, every mirror reads its part at the same time
+static const u32 MIRROR_SPLIT_SIZE = 256 * 1024;
+
 SmartArrayRaid1Reader::SmartArrayRaid1Reader(const SmartArrayRaid1ReaderOptions& options)
 {
     this->driveName = options.readerName;
@@ -30,6 +38,17 @@ SmartArrayRaid1Reader::SmartArrayRaid1Reader(const SmartArrayRaid1ReaderOptions&
     }
 
     this->singleDriveSize = *std::min_element(drivesSizes.begin(), drivesSizes.end());
+    this->readsInFlight = std::vector<std::atomic<u32>>(this->drives.size());
+    this->lastReadEnd = std::vector<std::atomic<u64>>(this->drives.size());
+    this->bytesRead = std::vector<std::atomic<u64>>(this->drives.size());
+
+    // Parts of split read have to be read at the same time, otherwise splitting gains nothing.
+    // io_uring and thread pool engines do that already, sync engine needs threads of our own.
+    if (this->drives.size() > 1 && std::dynamic_pointer_cast<SequentialDriveReader>(this->asyncReader))
+    {
+        // Calling thread reads one of the parts itself
+        this->asyncReader = std::make_shared<ThreadPoolDriveReader>(this->drives.size() - 1);
+    }
 
     // 32MiB from the end of drive are stored controller's metadata.
     this->singleDriveSize -= 1024 * 1024 * 32;
@@ -44,7 +63,17 @@ SmartArrayRaid1Reader::SmartArrayRaid1Reader(const SmartArrayRaid1ReaderOptions&
     }
 }
 
-int SmartArrayRaid1Reader::read(void *buf, u32 len, u64 offset)
+SmartArrayRaid1Reader::~SmartArrayRaid1Reader()
+{
+    this->stopReadahead();
+}
+
+u64 SmartArrayRaid1Reader::rowSize()
+{
+    return MIRROR_ROW_SIZE;
+}
+
+int SmartArrayRaid1Reader::readArray(void *buf, u32 len, u64 offset)
 {
     if (offset >= this->driveSize())
     {
@@ -54,15 +83,169 @@ int SmartArrayRaid1Reader::read(void *buf, u32 len, u64 offset)
         return -1;
     }
 
-    for (int i = 0; i < this->drives.size(); i++)
+    u64 driveOffset = offset + this->getPhysicalDriveOffset();
+    u16 mirrors = this->drives.size();
+
+    if (mirrors == 1 || len < MIRROR_SPLIT_SIZE)
+    {
+        return this->readFromMirror(this->pickMirror(driveOffset), buf, len, driveOffset);
+    }
+
+    // Big read is split into one part for every mirror, so all of them stream at once.
+    // Parts are aligned to 4KiB, so they stay aligned for O_DIRECT.
+    u32 partLen = (len / mirrors + 4095) / 4096 * 4096;
+    std::vector<ReadRequest> parts;
+    for (u32 pos = 0; pos < len; pos += partLen)
+    {
+        u16 mirror = parts.size();
+        u32 thisPartLen = std::min(partLen, len - pos);
+        parts.push_back({ this->drives[mirror].get(), static_cast<char*>(buf) + pos, thisPartLen, driveOffset + pos });
+    }
+
+    this->readParts(parts);
+    return 0;
+}
+
+int SmartArrayRaid1Reader::readv(const iovec* iov, int iovcnt, u64 offset)
+{
+    u64 len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].iov_len;
+    }
+
+    u16 mirrors = this->drives.size();
+    if (mirrors == 1 || len < MIRROR_SPLIT_SIZE || offset + len > this->driveSize() || this->readaheadEnabled())
     {
+        return DriveReader::readv(iov, iovcnt, offset);
+    }
+
+    // RAID 10 reads many stripes of the mirror with one vectored request, they're split
+    // between mirrors on buffer boundaries, each mirror gets its part as vectored request too
+    u64 driveOffset = offset + this->getPhysicalDriveOffset();
+    u64 partTarget = (len + mirrors - 1) / mirrors;
+    std::vector<ReadRequest> parts;
+    int first = 0;
+    u64 partLen = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        partLen += iov[i].iov_len;
+        if (partLen >= partTarget || i + 1 == iovcnt)
+        {
+            u16 mirror = parts.size();
+            parts.push_back({ this->drives[mirror].get(), iov[first].iov_base, static_cast<u32>(partLen), driveOffset,
+                              iov + first, i + 1 - first });
+            driveOffset += partLen;
+            first = i + 1;
+            partLen = 0;
+        }
+    }
+
+    this->readParts(parts);
+    return 0;
+}
+
+void SmartArrayRaid1Reader::readParts(std::vector<ReadRequest>& parts)
+{
+    for (size_t mirror = 0; mirror < parts.size(); mirror++)
+    {
+        this->readsInFlight[mirror]++;
+    }
+
+    bool failed = false;
+    try
+    {
+        this->asyncReader->readAll(parts);
+    }
+    catch (std::exception& ex)
+    {
+        // Not only read errors, nested readers and the engine itself can throw other exceptions too,
+        // they go to the fallback as well, so readsInFlight is always decremented
+        failed = true;
+    }
+
+    for (size_t mirror = 0; mirror < parts.size(); mirror++)
+    {
+        auto& part = parts[mirror];
+        this->readsInFlight[mirror]--;
+        this->lastReadEnd[mirror] = part.offset + part.len;
+        this->bytesRead[mirror] += part.len;
+    }
+
+    if (!failed)
+    {
+        return;
+    }
+
+    // It's not known which part has failed, so all of them are read again with falling back to the other mirrors
+    for (size_t mirror = 0; mirror < parts.size(); mirror++)
+    {
+        auto& part = parts[mirror];
+        if (part.iovcnt == 0)
+        {
+            this->readFromMirror(mirror, part.buf, part.len, part.offset);
+            continue;
+        }
+
+        u64 offset = part.offset;
+        for (int i = 0; i < part.iovcnt; i++)
+        {
+            this->readFromMirror(mirror, part.iov[i].iov_base, part.iov[i].iov_len, offset);
+            offset += part.iov[i].iov_len;
+        }
+    }
+}
+
+u16 SmartArrayRaid1Reader::pickMirror(u64 driveOffset)
+{
+    u16 mirrors = this->drives.size();
+    u16 start = this->nextMirror++ % mirrors;
+
+    // Mirror with the shortest queue, starting from a different one every time
+    u16 best = start;
+    for (u16 i = 1; i < mirrors; i++)
+    {
+        u16 mirror = (start + i) % mirrors;
+        if (this->readsInFlight[mirror] < this->readsInFlight[best])
+        {
+            best = mirror;
+        }
+    }
+
+    // Sequential stream stays on its mirror, drive has the data in its own cache already,
+    // unless the mirror is busier than the others
+    for (u16 i = 0; i < mirrors; i++)
+    {
+        if (this->lastReadEnd[i] == driveOffset && this->readsInFlight[i] <= this->readsInFlight[best])
+        {
+            return i;
+        }
+    }
+
+    return best;
+}
+
+int SmartArrayRaid1Reader::readFromMirror(u16 mirror, void* buf, u32 len, u64 driveOffset)
+{
+    u16 mirrors = this->drives.size();
+
+    for (u16 attempt = 0; attempt < mirrors; attempt++)
+    {
+        u16 i = (mirror + attempt) % mirrors;
+        this->readsInFlight[i]++;
+
         try
         {
-            return this->drives[i]->read(buf, len, offset + this->getPhysicalDriveOffset());
+            int ret = this->drives[i]->read(buf, len, driveOffset);
+            this->readsInFlight[i]--;
+            this->lastReadEnd[i] = driveOffset + len;
+            this->bytesRead[i] += len;
+            return ret;
         }
         catch (std::exception& ex)
         {
-            if (( i + 1 ) >= this->drives.size())
+            this->readsInFlight[i]--;
+            if (( attempt + 1 ) >= mirrors)
             {
                 throw;
             }
@@ -76,4 +259,41 @@ int SmartArrayRaid1Reader::read(void *buf, u32 len, u64 offset)
     return -1;
 }
 
+bool SmartArrayRaid1Reader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    if (offset + len > this->driveSize())
+    {
+        return false;
+    }
+
+    // Failing drive is handled by read, when sending data from this one fails
+    u64 driveOffset = offset + this->getPhysicalDriveOffset();
+    u16 mirror = this->pickMirror(driveOffset);
+    if (!this->drives[mirror]->mapExtents(len, driveOffset, extents))
+    {
+        return false;
+    }
+
+    this->lastReadEnd[mirror] = driveOffset + len;
+    this->bytesRead[mirror] += len;
+    return true;
+}
+
+void SmartArrayRaid1Reader::printStats(std::ostream& out)
+{
+    SmartArrayReaderBase::printStats(out);
+    if (this->drives.size() < 2)
+    {
+        return;
+    }
+
+    out << "Mirror reads:";
+    for (size_t i = 0; i < this->drives.size(); i++)
+    {
+        out << " " << this->drives[i]->name() << " " << this->bytesRead[i] / (1024 * 1024) << " MiB"
+            << (i + 1 < this->drives.size() ? "," : "");
+    }
+    out << std::endl;
+}
+
 } // end namespace sg
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "smart_array_raid_50_reader.hpp"
+#include <stdexcept>
 #include <iostream>
 
 namespace sg
@@ -68,20 +69,42 @@ SmartArrayRaid50Reader::SmartArrayRaid50Reader(const SmartArrayRaid50ReaderOptio
         // "touching" physical drives direcly but rather thru
         // raid 5 readers
         .offset = 0,
-        .nometadata = true
+        .nometadata = true,
+        .parallelDrives = true
     };
 
     this->raid0Reader = std::make_unique<SmartArrayRaid0Reader>(reader0Options);
 }
 
-int SmartArrayRaid50Reader::read(void *buf, u32 len, u64 offset)
+SmartArrayRaid50Reader::~SmartArrayRaid50Reader()
+{
+    this->stopReadahead();
+}
+
+u64 SmartArrayRaid50Reader::rowSize()
+{
+    return this->raid0Reader->rowSize();
+}
+
+int SmartArrayRaid50Reader::readArray(void *buf, u32 len, u64 offset)
 {
     return this->raid0Reader->read(buf, len, offset);
 }
 
+bool SmartArrayRaid50Reader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    return this->raid0Reader->mapExtents(len, offset, extents);
+}
+
 u64 SmartArrayRaid50Reader::driveSize()
 {
     return this->raid0Reader->driveSize();
 }
 
+void SmartArrayRaid50Reader::printStats(std::ostream& out)
+{
+    SmartArrayReaderBase::printStats(out);
+    this->raid0Reader->printStats(out);
+}
+
 } // end namespace sg
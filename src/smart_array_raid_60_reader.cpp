@@ -1,4 +1,5 @@
 #include "smart_array_raid_60_reader.hpp"
+#include <stdexcept>
 
 namespace sg
 {
@@ -47,6 +48,7 @@ SmartArrayRaid60Reader::SmartArrayRaid60Reader(const SmartArrayRaid60ReaderOptio
             parityOptions.readerName.erase(parityOptions.readerName.end() - 1);
             parityOptions.stripeSize = options.stripeSize;
             parityOptions.parityDelay = options.parityDelay;
+            parityOptions.reedSolomonCoefficients = options.reedSolomonCoefficients;
             parityOptions.size = options.size / options.parityGroups;
             parityOptions.offset = options.offset;
 
@@ -67,20 +69,42 @@ SmartArrayRaid60Reader::SmartArrayRaid60Reader(const SmartArrayRaid60ReaderOptio
         // "touching" physical drives direcly but rather thru
         // raid 6 readers
         .offset = 0,
-        .nometadata = true
+        .nometadata = true,
+        .parallelDrives = true
     };
 
     this->raid0Reader = std::make_unique<SmartArrayRaid0Reader>(reader0Options);
 }
 
-int SmartArrayRaid60Reader::read(void *buf, u32 len, u64 offset)
+SmartArrayRaid60Reader::~SmartArrayRaid60Reader()
+{
+    this->stopReadahead();
+}
+
+u64 SmartArrayRaid60Reader::rowSize()
+{
+    return this->raid0Reader->rowSize();
+}
+
+int SmartArrayRaid60Reader::readArray(void *buf, u32 len, u64 offset)
 {
     return this->raid0Reader->read(buf, len, offset);
 }
 
+bool SmartArrayRaid60Reader::mapExtents(u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    return this->raid0Reader->mapExtents(len, offset, extents);
+}
+
 u64 SmartArrayRaid60Reader::driveSize()
 {
     return this->raid0Reader->driveSize();
 }
 
+void SmartArrayRaid60Reader::printStats(std::ostream& out)
+{
+    SmartArrayReaderBase::printStats(out);
+    this->raid0Reader->printStats(out);
+}
+
 } // end namespace sg
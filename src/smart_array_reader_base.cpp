@@ -1,8 +1,20 @@
 #include "smart_array_reader_base.hpp"
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <string.h>
 
 namespace sg
 {
 
+SmartArrayReaderBase::SmartArrayReaderBase()
+{
+    this->asyncReader = getDefaultAsyncReader();
+}
+
 void SmartArrayReaderBase::setSize(u64 size, u64 maximumSize)
 {
     if (size > maximumSize && maximumSize != 0)
@@ -14,6 +26,425 @@ void SmartArrayReaderBase::setSize(u64 size, u64 maximumSize)
     this->size = size;
 }
 
+int SmartArrayReaderBase::read(void* buf, u32 len, u64 offset)
+{
+    // Reads past the end go straight to the reader, which reports them
+    if (!this->readahead || offset >= this->driveSize() || len > this->driveSize() - offset)
+    {
+        return this->readArray(buf, len, offset);
+    }
+
+    this->readahead->read(buf, len, offset);
+    return 0;
+}
+
+void SmartArrayReaderBase::enableReadahead(u32 depth)
+{
+    auto read = [this](void* buf, u32 len, u64 offset) { this->readArray(buf, len, offset); };
+    this->readahead = std::make_unique<Readahead>(read, this->rowSize(), depth, this->driveSize());
+}
+
+bool SmartArrayReaderBase::mapStripes(const StripeGeometry& geometry, const std::vector<std::shared_ptr<DriveReader>>& drives,
+                                      u32 len, u64 offset, std::vector<DriveExtent>& extents)
+{
+    if (offset + len > this->driveSize())
+    {
+        return false;
+    }
+
+    StripeLocation location = geometry.locate(offset);
+
+    while (len != 0)
+    {
+        u32 stripeLen = std::min(len, geometry.stripeSize(location) - location.relativeOffset);
+        u16 drivenum = geometry.driveNumber(location);
+        u64 driveOffset = geometry.driveOffset(location);
+        auto& drive = drives[drivenum];
+
+        if (!drive || !this->canMapDrive(drivenum, driveOffset, stripeLen) ||
+            !drive->mapExtents(stripeLen, driveOffset, extents))
+        {
+            return false;
+        }
+
+        len -= stripeLen;
+        if (len > 0)
+        {
+            geometry.next(location);
+        }
+    }
+
+    return true;
+}
+
+bool SmartArrayReaderBase::canMapDrive(u16 drivenum, u64 driveOffset, u32 len)
+{
+    // Slow drive treated as missing would be read by splice anyway, without hedging
+    return !this->badSectors.overlaps(drivenum, driveOffset, len) && !this->isDemoted(drivenum);
+}
+
+bool SmartArrayReaderBase::readaheadEnabled()
+{
+    return this->readahead != nullptr;
+}
+
+void SmartArrayReaderBase::stopReadahead()
+{
+    if (this->readahead)
+    {
+        this->readahead->stop();
+    }
+}
+
+void SmartArrayReaderBase::rebuildMember(void* buf, u16 drivenum, u32 len, u64 driveOffset)
+{
+    throw std::invalid_argument("Drives of this RAID level can't be rebuilt, only RAID 5 and 6 are supported.");
+}
+
+u64 SmartArrayReaderBase::memberDataSize()
+{
+    return this->singleDriveSize;
+}
+
+std::pair<u64, u64> SmartArrayReaderBase::rebuiltArea()
+{
+    return { 0, this->memberDataSize() };
+}
+
+u64 SmartArrayReaderBase::stripeRows()
+{
+    return (this->driveSize() + this->rowSize() - 1) / this->rowSize();
+}
+
+void SmartArrayReaderBase::verifyRows(u64 firstRow, u32 count, BadRowList& badRows)
+{
+    throw std::invalid_argument("Parity of this RAID level can't be verified, only RAID 5 and 6 are supported.");
+}
+
+void SmartArrayReaderBase::setBadRows(std::shared_ptr<const BadRowList> badRows)
+{
+    this->badRows = badRows;
+}
+
+void SmartArrayReaderBase::checkBadRow(u64 row)
+{
+    if (!this->badRows || !this->badRows->contains(row))
+    {
+        return;
+    }
+
+    if (this->badRowReconstructions++ == 0)
+    {
+        std::cerr << "Warning: Data of row " << row << " was reconstructed, but its parity doesn't match "
+                  << "its data according to bad row list. Reconstructed data may be wrong." << std::endl;
+    }
+}
+
+// Threads reading slow drives, abandoned reads keep them busy until the drive answers
+static const u32 HEDGE_THREADS = 4;
+
+struct SmartArrayReaderBase::HedgedRead
+{
+    ReadRequest request;
+    u16 drivenum;
+    std::vector<char> buffer;
+    std::chrono::steady_clock::time_point deadline;
+
+    std::mutex mutex;
+    std::condition_variable finishedReading;
+    bool finished = false;
+    bool failed = false;
+};
+
+static u16 driveIndex(const std::vector<std::shared_ptr<DriveReader>>& drives, DriveReader* drive)
+{
+    return std::find_if(drives.begin(), drives.end(), [drive](auto& member) {
+        return member.get() == drive;
+    }) - drives.begin();
+}
+
+static u64 microsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SmartArrayReaderBase::enableHedging()
+{
+    u16 spare = this->spareDrives();
+    if (spare == 0)
+    {
+        throw std::invalid_argument("Reads can be hedged only in RAID 5 and 6 which can lose another drive.");
+    }
+
+    this->latency = std::make_shared<LatencyTracker>(spare);
+    this->hedgePool = std::make_unique<ThreadPool>(HEDGE_THREADS);
+}
+
+u16 SmartArrayReaderBase::spareDrives()
+{
+    return 0;
+}
+
+bool SmartArrayReaderBase::isDemoted(u16 drivenum)
+{
+    return this->latency && this->latency->isDemoted(drivenum);
+}
+
+void SmartArrayReaderBase::readMembers(std::vector<ReadRequest>& requests, const std::vector<std::shared_ptr<DriveReader>>& drives,
+                                       const RecoverFunction& recover)
+{
+    if (!this->latency)
+    {
+        this->readBatch(requests, drives, recover);
+        return;
+    }
+
+    // Requests of slow drives are taken out of the batch, so it doesn't wait for them
+    std::vector<ReadRequest> batch;
+    std::vector<std::shared_ptr<HedgedRead>> hedged;
+    batch.reserve(requests.size());
+
+    for (auto& request : requests)
+    {
+        u16 drivenum = driveIndex(drives, request.drive);
+        switch (this->latency->policyFor(drivenum))
+        {
+        case DrivePolicy::Read:
+            batch.push_back(request);
+            break;
+        case DrivePolicy::Hedge:
+            hedged.push_back(this->startHedgedRead(drives[drivenum], drivenum, request));
+            break;
+        case DrivePolicy::Reconstruct:
+            this->demotedReads++;
+            this->recoverRequest(request, drivenum, recover);
+            break;
+        }
+    }
+
+    this->readBatch(batch, drives, recover);
+
+    for (auto& read : hedged)
+    {
+        this->finishHedgedRead(*read, recover);
+    }
+}
+
+void SmartArrayReaderBase::readBatch(std::vector<ReadRequest>& requests, const std::vector<std::shared_ptr<DriveReader>>& drives,
+                                     const RecoverFunction& recover)
+{
+    // Drive is charged with time from the previous completion to its own, so it's
+    // how long the batch waited for it, no matter if requests are read at once or one after another
+    auto previous = std::chrono::steady_clock::now();
+    ReadCompletedCallback timing = nullptr;
+    if (this->latency)
+    {
+        timing = [&](ReadRequest& request) {
+            this->latency->record(driveIndex(drives, request.drive), microsSince(previous));
+            previous = std::chrono::steady_clock::now();
+        };
+    }
+
+    try
+    {
+        this->asyncReader->readAll(requests, timing);
+        return;
+    }
+    catch (std::runtime_error& ex)
+    {
+        // It's not known which request has failed, so all of them are read again
+    }
+
+    for (auto& request : requests)
+    {
+        u16 drivenum = driveIndex(drives, request.drive);
+
+        if (request.iovcnt == 0)
+        {
+            this->readSegment(request.drive, drivenum, request.buf, request.len, request.offset, recover);
+            continue;
+        }
+
+        u64 offset = request.offset;
+        for (int i = 0; i < request.iovcnt; i++)
+        {
+            this->readSegment(request.drive, drivenum, request.iov[i].iov_base, request.iov[i].iov_len, offset, recover);
+            offset += request.iov[i].iov_len;
+        }
+    }
+}
+
+void SmartArrayReaderBase::recoverRequest(const ReadRequest& request, u16 drivenum, const RecoverFunction& recover)
+{
+    if (request.iovcnt == 0)
+    {
+        recover(request.buf, drivenum, request.offset, request.len);
+        return;
+    }
+
+    u64 offset = request.offset;
+    for (int i = 0; i < request.iovcnt; i++)
+    {
+        recover(request.iov[i].iov_base, drivenum, offset, request.iov[i].iov_len);
+        offset += request.iov[i].iov_len;
+    }
+}
+
+std::shared_ptr<SmartArrayReaderBase::HedgedRead> SmartArrayReaderBase::startHedgedRead(
+    std::shared_ptr<DriveReader> drive, u16 drivenum, const ReadRequest& request)
+{
+    // Drive reads into its own buffer, if it's too late caller's buffer is already filled by reconstruction
+    auto hedged = std::make_shared<HedgedRead>();
+    hedged->request = request;
+    hedged->drivenum = drivenum;
+    hedged->buffer.resize(request.len);
+    hedged->deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(this->latency->hedgeDeadline(drivenum));
+    this->hedgedReads++;
+
+    auto latency = this->latency;
+    this->hedgePool->post([hedged, drive, latency]() {
+        auto start = std::chrono::steady_clock::now();
+        bool failed;
+        try
+        {
+            failed = drive->read(hedged->buffer.data(), hedged->request.len, hedged->request.offset) != 0;
+        }
+        catch (std::exception&)
+        {
+            failed = true;
+        }
+        latency->record(hedged->drivenum, microsSince(start));
+
+        {
+            std::lock_guard<std::mutex> lock(hedged->mutex);
+            hedged->finished = true;
+            hedged->failed = failed;
+        }
+        hedged->finishedReading.notify_all();
+    });
+
+    return hedged;
+}
+
+void SmartArrayReaderBase::finishHedgedRead(HedgedRead& hedged, const RecoverFunction& recover)
+{
+    bool readInTime;
+    {
+        std::unique_lock<std::mutex> lock(hedged.mutex);
+        readInTime = hedged.finishedReading.wait_until(lock, hedged.deadline, [&hedged]() { return hedged.finished; }) &&
+                     !hedged.failed;
+    }
+
+    if (!readInTime)
+    {
+        this->hedgesReconstructed++;
+        this->recoverRequest(hedged.request, hedged.drivenum, recover);
+        return;
+    }
+
+    auto& request = hedged.request;
+    if (request.iovcnt == 0)
+    {
+        memcpy(request.buf, hedged.buffer.data(), request.len);
+        return;
+    }
+
+    const char* data = hedged.buffer.data();
+    for (int i = 0; i < request.iovcnt; i++)
+    {
+        memcpy(request.iov[i].iov_base, data, request.iov[i].iov_len);
+        data += request.iov[i].iov_len;
+    }
+}
+
+void SmartArrayReaderBase::addUnreadableRanges(const std::vector<std::shared_ptr<DriveReader>>& drives)
+{
+    for (size_t i = 0; i < drives.size(); i++)
+    {
+        if (!drives[i])
+        {
+            continue;
+        }
+
+        u64 unreadable = 0;
+        for (auto& [start, end] : drives[i]->unreadableRanges())
+        {
+            this->badSectors.add(i, start, end - start);
+            unreadable += end - start;
+        }
+
+        if (unreadable > 0 && this->spareDrives() == 0)
+        {
+            std::cerr << "Warning: " << drives[i]->name() << " has " << unreadable << " unreadable bytes, but the array"
+                      << " has no redundancy left to reconstruct them. Reads of them will fail." << std::endl;
+        }
+    }
+}
+
+void SmartArrayReaderBase::readSegment(DriveReader* drive, u16 drivenum, void* buf, u32 len, u64 offset,
+                                       const RecoverFunction& recover)
+{
+    try
+    {
+        if (drive->read(buf, len, offset) == 0)
+        {
+            return;
+        }
+    }
+    catch (std::runtime_error& ex)
+    {
+        std::cerr << this->name() << ": " << ex.what() << " Looking for unreadable sectors to reconstruct them." << std::endl;
+    }
+
+    // Pieces are aligned to the drive, so the same bad sector is always in the same piece
+    char* out = static_cast<char*>(buf);
+    u64 end = offset + len;
+    u64 pos = offset;
+    while (pos < end)
+    {
+        u64 pieceEnd = std::min(end, (pos / BAD_SECTOR_PROBE_SIZE + 1) * BAD_SECTOR_PROBE_SIZE);
+        u32 pieceLen = pieceEnd - pos;
+        char* pieceBuf = out + (pos - offset);
+
+        bool bad = false;
+        try
+        {
+            bad = drive->read(pieceBuf, pieceLen, pos) != 0;
+        }
+        catch (std::runtime_error& ex)
+        {
+            bad = true;
+        }
+
+        if (bad)
+        {
+            this->badSectors.add(drivenum, pos, pieceLen);
+            recover(pieceBuf, drivenum, pos, pieceLen);
+        }
+        pos = pieceEnd;
+    }
+}
+
+void SmartArrayReaderBase::printStats(std::ostream& out)
+{
+    if (this->readahead)
+    {
+        this->readahead->printStats(out);
+    }
+    if (this->badRowReconstructions > 0)
+    {
+        out << "Bad rows: " << this->badRowReconstructions << " stripes reconstructed from rows with mismatching parity" << std::endl;
+    }
+    this->badSectors.printStats(out);
+    if (this->latency)
+    {
+        this->latency->printStats(out);
+        out << "Hedged reads: " << this->hedgedReads << ", " << this->hedgesReconstructed
+            << " of them reconstructed because drive was too slow or failed, "
+            << this->demotedReads << " reads of demoted drives reconstructed" << std::endl;
+    }
+}
+
 u64 SmartArrayReaderBase::driveSize()
 {
     return this->size;
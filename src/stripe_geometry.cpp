@@ -0,0 +1,98 @@
+#include "stripe_geometry.hpp"
+#include <bit>
+
+namespace sg
+{
+
+StripeGeometry::StripeGeometry(u32 stripeSize, u16 drives, u16 parityDrives, u16 parityDelay, u64 size, u64 physicalDriveOffset)
+{
+    this->fullStripeSize = stripeSize;
+    this->drives = drives;
+    this->dataDrives = drives - parityDrives;
+    this->physicalDriveOffset = physicalDriveOffset;
+
+    bool powerOfTwo = std::has_single_bit(stripeSize);
+    this->stripeShift = powerOfTwo ? std::countr_zero(stripeSize) : 0;
+    this->stripeMask = powerOfTwo ? stripeSize - 1 : 0;
+
+    this->rowSize = static_cast<u64>(stripeSize) * this->dataDrives;
+    this->lastRow = size / this->rowSize;
+
+    // Stripes of the last row are rounded up, so its every byte falls into one of data drives
+    // even if it isn't divisible by their number. Only the last stripe is then partially used.
+    u64 lastRowBytes = size - this->lastRow * this->rowSize;
+    this->lastRowStripeSize = lastRowBytes == 0 ? stripeSize : (lastRowBytes + this->dataDrives - 1) / this->dataDrives;
+
+    // Without parity every row looks the same
+    this->cycleRows = parityDrives == 0 ? 1 : drives * parityDelay;
+
+    this->dataDriveTable.resize(this->cycleRows * this->dataDrives);
+    this->dataIndexTable.resize(this->cycleRows * drives);
+    this->parityTable.resize(this->cycleRows, NOT_DATA_DRIVE);
+    this->reedSolomonTable.resize(this->cycleRows, NOT_DATA_DRIVE);
+
+    for (u32 row = 0; row < this->cycleRows; row++)
+    {
+        if (parityDrives == 1)
+        {
+            this->parityTable[row] = drives - (row / parityDelay) - 1;
+        }
+        else if (parityDrives == 2)
+        {
+            // Parity is one drive before Reed Solomon, so it's parityDelay rows ahead in the cycle
+            this->reedSolomonTable[row] = drives - (row / parityDelay) - 1;
+            this->parityTable[row] = drives - (((row + parityDelay) % this->cycleRows) / parityDelay) - 1;
+        }
+
+        // Data stripes go to remaining drives, in order of drives
+        u16 column = 0;
+        for (u16 drive = 0; drive < drives; drive++)
+        {
+            if (drive == this->parityTable[row] || drive == this->reedSolomonTable[row])
+            {
+                this->dataIndexTable[row * drives + drive] = NOT_DATA_DRIVE;
+                continue;
+            }
+
+            this->dataDriveTable[row * this->dataDrives + column] = drive;
+            this->dataIndexTable[row * drives + drive] = column;
+            column++;
+        }
+    }
+}
+
+StripeLocation StripeGeometry::locate(u64 offset) const
+{
+    StripeLocation location;
+    location.row = offset / this->rowSize;
+    location.cycleRow = location.row % this->cycleRows;
+
+    u64 rowRelativeOffset = offset - location.row * this->rowSize;
+
+    if (location.row == this->lastRow)
+    {
+        location.column = rowRelativeOffset / this->lastRowStripeSize;
+        location.relativeOffset = rowRelativeOffset % this->lastRowStripeSize;
+    }
+    else if (this->stripeShift != 0)
+    {
+        location.column = rowRelativeOffset >> this->stripeShift;
+        location.relativeOffset = rowRelativeOffset & this->stripeMask;
+    }
+    else
+    {
+        location.column = rowRelativeOffset / this->fullStripeSize;
+        location.relativeOffset = rowRelativeOffset % this->fullStripeSize;
+    }
+
+    return location;
+}
+
+u32 StripeGeometry::cycleRowOf(u64 driveOffset) const
+{
+    u64 offset = driveOffset - this->physicalDriveOffset;
+    u64 row = this->stripeShift != 0 ? offset >> this->stripeShift : offset / this->fullStripeSize;
+    return row % this->cycleRows;
+}
+
+} // end namespace sg
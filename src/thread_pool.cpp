@@ -0,0 +1,64 @@
+#include "thread_pool.hpp"
+
+namespace sg
+{
+
+ThreadPool::ThreadPool(u32 threads)
+{
+    for (u32 i = 0; i < threads; i++)
+    {
+        this->workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->tasksAvailable.notify_all();
+
+    for (auto& worker : this->workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->tasks.push_back(std::move(task));
+    }
+    this->tasksAvailable.notify_one();
+}
+
+u32 ThreadPool::size()
+{
+    return this->workers.size();
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->tasksAvailable.wait(lock, [this] { return this->stopping || !this->tasks.empty(); });
+
+            if (this->tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+} // end namespace sg
@@ -0,0 +1,145 @@
+#include "thread_pool_drive_reader.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+
+namespace sg
+{
+
+/// @brief State of one readAll call shared with pool threads.
+/// Pool task can start after readAll has returned, that's why it's in shared_ptr
+/// and requests are touched only after successfully claiming one of them.
+struct ReadBatch
+{
+    std::vector<ReadRequest>* requests;
+    size_t requestCount;
+    std::atomic<size_t> nextRequest { 0 };
+
+    std::mutex mutex;
+    std::condition_variable requestFinished;
+    std::vector<size_t> completed;
+    size_t finished = 0;
+    std::string error;
+
+    /// @brief Reads one not yet claimed request, returns false if there were none left.
+    bool readNext()
+    {
+        size_t i = this->nextRequest++;
+        if (i >= this->requestCount)
+        {
+            return false;
+        }
+
+        auto& request = (*this->requests)[i];
+        std::string readError;
+
+        // Not only read errors, nested RAID readers can throw std::bad_alloc too,
+        // and anything escaping pool thread would terminate the program
+        try
+        {
+            readRequest(request);
+        }
+        catch (std::exception& ex)
+        {
+            readError = ex.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (readError.empty())
+            {
+                this->completed.push_back(i);
+            }
+            else if (this->error.empty())
+            {
+                this->error = readError;
+            }
+            this->finished++;
+        }
+        this->requestFinished.notify_one();
+
+        return true;
+    }
+};
+
+ThreadPoolDriveReader::ThreadPoolDriveReader(u32 threads)
+    : pool(threads)
+{
+}
+
+void ThreadPoolDriveReader::readAll(std::vector<ReadRequest>& requests, const ReadCompletedCallback& onCompleted)
+{
+    auto batch = std::make_shared<ReadBatch>();
+    batch->requests = &requests;
+    batch->requestCount = requests.size();
+
+    // Caller takes one request too, so we need one helper less
+    size_t helpers = requests.empty() ? 0 : std::min<size_t>(requests.size() - 1, this->pool.size());
+    for (size_t i = 0; i < helpers; i++)
+    {
+        this->pool.post([batch] {
+            while (batch->readNext());
+        });
+    }
+
+    std::vector<size_t> completed;
+    std::string callbackError;
+    bool workLeft = true;
+
+    while (true)
+    {
+        if (workLeft)
+        {
+            workLeft = batch->readNext();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            if (!workLeft)
+            {
+                batch->requestFinished.wait(lock, [&] {
+                    return !batch->completed.empty() || batch->finished == requests.size();
+                });
+            }
+            completed.swap(batch->completed);
+        }
+
+        // Callbacks are run here, in the calling thread, one after another
+        for (size_t i : completed)
+        {
+            try
+            {
+                if (onCompleted && callbackError.empty())
+                {
+                    onCompleted(requests[i]);
+                }
+            }
+            catch (std::exception& ex)
+            {
+                callbackError = ex.what();
+            }
+        }
+        completed.clear();
+
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        if (batch->finished == requests.size() && batch->completed.empty())
+        {
+            break;
+        }
+    }
+
+    if (!batch->error.empty())
+    {
+        throw std::runtime_error(batch->error);
+    }
+    if (!callbackError.empty())
+    {
+        throw std::runtime_error(callbackError);
+    }
+}
+
+} // end namespace sg
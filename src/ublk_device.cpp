@@ -0,0 +1,383 @@
+#include "ublk_device.hpp"
+#include "io_uring_queue.hpp"
+#include <linux/ublk_cmd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <iostream>
+
+namespace sg
+{
+
+static const char* UBLK_CONTROL_PATH = "/dev/ublk-control";
+
+// Kernel internal errno, returned by kernels which don't know a command
+static const int KERNEL_ENOTSUPP = 524;
+
+static std::string errorMessage(const std::string& what, int error)
+{
+    return what + " has failed. Reason: " + strerror(error);
+}
+
+UblkDevice::UblkDevice(const UblkDeviceOptions& options)
+{
+    this->options = options;
+
+    this->controlFd = open(UBLK_CONTROL_PATH, O_RDWR);
+    if (this->controlFd < 0)
+    {
+        throw std::runtime_error(errorMessage(std::string("Opening ") + UBLK_CONTROL_PATH, errno));
+    }
+
+    ublksrv_ctrl_dev_info info;
+    memset(&info, 0, sizeof(info));
+    info.nr_hw_queues = options.queues;
+    info.queue_depth = options.queueDepth;
+    info.max_io_buf_bytes = options.maxIoSize;
+    info.dev_id = options.deviceId;
+
+    int res;
+    try
+    {
+        // Control commands don't fit into 64 byte submissions
+        this->controlQueue = std::make_unique<IoUringQueue>(4, IORING_SETUP_SQE128);
+
+        res = this->controlCommand(UBLK_CMD_ADD_DEV, -1, &info, sizeof(info), 0);
+        if (res == -EOPNOTSUPP || res == -KERNEL_ENOTSUPP)
+        {
+            // Kernels older than 6.4 know only legacy opcodes
+            this->encodedOpcodes = false;
+            res = this->controlCommand(UBLK_CMD_ADD_DEV, -1, &info, sizeof(info), 0);
+        }
+    }
+    catch (std::runtime_error&)
+    {
+        this->controlQueue.reset();
+        close(this->controlFd);
+        throw;
+    }
+
+    if (res < 0)
+    {
+        this->controlQueue.reset();
+        close(this->controlFd);
+        throw std::runtime_error(errorMessage("Adding ublk device", -res));
+    }
+
+    // Kernel picks device number and can lower our limits
+    this->options.deviceId = info.dev_id;
+    this->options.queueDepth = info.queue_depth;
+    this->options.maxIoSize = info.max_io_buf_bytes;
+
+    try
+    {
+        ublk_params params;
+        memset(&params, 0, sizeof(params));
+        params.len = sizeof(params);
+        params.types = UBLK_PARAM_TYPE_BASIC;
+        params.basic.attrs = UBLK_ATTR_READ_ONLY;
+        params.basic.logical_bs_shift = 9;
+        params.basic.physical_bs_shift = 12;
+        params.basic.io_opt_shift = 12;
+        params.basic.io_min_shift = 9;
+        params.basic.max_sectors = this->options.maxIoSize >> 9;
+        params.basic.dev_sectors = this->options.size >> 9;
+
+        res = this->controlCommand(UBLK_CMD_SET_PARAMS, -1, &params, sizeof(params), 0);
+        if (res < 0)
+        {
+            throw std::runtime_error(errorMessage("Setting ublk device parameters", -res));
+        }
+
+        this->openCharDevice();
+    }
+    catch (std::runtime_error&)
+    {
+        this->controlCommand(UBLK_CMD_DEL_DEV, -1, nullptr, 0, 0);
+        this->controlQueue.reset();
+        close(this->controlFd);
+        throw;
+    }
+}
+
+UblkDevice::~UblkDevice()
+{
+    // Driver waits for char device to be closed before it deletes the device
+    close(this->charFd);
+    this->controlCommand(UBLK_CMD_DEL_DEV, -1, nullptr, 0, 0);
+    this->controlQueue.reset();
+    close(this->controlFd);
+}
+
+int UblkDevice::deviceId()
+{
+    return this->options.deviceId;
+}
+
+std::string UblkDevice::blockDevicePath()
+{
+    return "/dev/ublkb" + std::to_string(this->options.deviceId);
+}
+
+bool UblkDevice::isSupported()
+{
+    return access(UBLK_CONTROL_PATH, F_OK) == 0;
+}
+
+int UblkDevice::controlCommand(u32 opcode, u16 queueId, void* buf, u16 len, u64 data)
+{
+    ublksrv_ctrl_cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.dev_id = this->options.deviceId;
+    cmd.queue_id = queueId;
+    cmd.len = len;
+    cmd.addr = reinterpret_cast<u64>(buf);
+    cmd.data[0] = data;
+
+    u32 op = this->encodedOpcodes ? _IOWR('u', opcode, ublksrv_ctrl_cmd) : opcode;
+    this->controlQueue->queueCommand(this->controlFd, op, &cmd, sizeof(cmd), 0);
+
+    io_uring_cqe cqe;
+    do
+    {
+        this->controlQueue->submit(1);
+    }
+    while (!this->controlQueue->popCompletion(cqe));
+
+    return cqe.res;
+}
+
+u32 UblkDevice::ioOpcode(u32 opcode)
+{
+    return this->encodedOpcodes ? _IOWR('u', opcode, ublksrv_io_cmd) : opcode;
+}
+
+void UblkDevice::openCharDevice()
+{
+    std::string path = "/dev/ublkc" + std::to_string(this->options.deviceId);
+
+    // udev can need a moment to create the node
+    for (int attempt = 0; attempt < 50; attempt++)
+    {
+        this->charFd = open(path.c_str(), O_RDWR);
+        if (this->charFd >= 0 || errno != ENOENT)
+        {
+            break;
+        }
+        usleep(100 * 1000);
+    }
+
+    if (this->charFd < 0)
+    {
+        throw std::runtime_error(errorMessage("Opening " + path, errno));
+    }
+}
+
+void UblkDevice::run()
+{
+    sigset_t signals, oldSignals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    // Queue threads inherit the mask, so signals go only to us
+    pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+
+    this->readyQueues = 0;
+    this->runningQueues = this->options.queues;
+    this->queueError.clear();
+
+    std::vector<std::thread> threads;
+    for (u16 queueId = 0; queueId < this->options.queues; queueId++)
+    {
+        threads.emplace_back(&UblkDevice::serveQueue, this, queueId, pthread_self());
+    }
+
+    std::string error;
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->queueReady.wait(lock, [this]() { return this->readyQueues == this->options.queues; });
+        error = this->queueError;
+    }
+
+    // Driver starts the device only when every queue has fetch commands waiting
+    if (error.empty())
+    {
+        int res = this->controlCommand(UBLK_CMD_START_DEV, -1, nullptr, 0, getpid());
+        if (res < 0)
+        {
+            error = errorMessage("Starting ublk device", -res);
+        }
+    }
+
+    if (error.empty())
+    {
+        int signal;
+        sigwait(&signals, &signal);
+    }
+
+    // It also aborts fetch commands of queues, so their threads can finish
+    this->controlCommand(UBLK_CMD_STOP_DEV, -1, nullptr, 0, 0);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Queue threads wake us with SIGTERM, its copy can't kill us once signals are unblocked
+    timespec noWait = { 0, 0 };
+    while (sigtimedwait(&signals, nullptr, &noWait) > 0)
+    {
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSignals, nullptr);
+
+    if (error.empty())
+    {
+        error = this->queueError;
+    }
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+}
+
+void UblkDevice::serveQueue(u16 queueId, pthread_t mainThread)
+{
+    u16 depth = this->options.queueDepth;
+    u32 maxIoSize = this->options.maxIoSize;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+
+    // Driver keeps descriptors of requests of every queue in memory mapped from char device
+    size_t descriptorsSize = (depth * sizeof(ublksrv_io_desc) + pageSize - 1) / pageSize * pageSize;
+    size_t queueStride = (UBLK_MAX_QUEUE_DEPTH * sizeof(ublksrv_io_desc) + pageSize - 1) / pageSize * pageSize;
+    off_t descriptorsOffset = UBLKSRV_CMD_BUF_OFFSET + queueId * queueStride;
+
+    void* descriptors = MAP_FAILED;
+    char* buffers = nullptr;
+    std::unique_ptr<IoUringQueue> ring;
+    u32 fetching = 0;
+    std::string error;
+
+    try
+    {
+        ring = std::make_unique<IoUringQueue>(depth);
+
+        descriptors = mmap(nullptr, descriptorsSize, PROT_READ, MAP_SHARED | MAP_POPULATE, this->charFd, descriptorsOffset);
+        if (descriptors == MAP_FAILED)
+        {
+            throw std::runtime_error(errorMessage("Mapping ublk request descriptors", errno));
+        }
+
+        buffers = static_cast<char*>(aligned_alloc(pageSize, static_cast<size_t>(depth) * maxIoSize));
+        if (buffers == nullptr)
+        {
+            throw std::runtime_error("Could not allocate ublk request buffers.");
+        }
+
+        // Every tag (request slot) gets its own buffer and waits for a request
+        for (u16 tag = 0; tag < depth; tag++)
+        {
+            ublksrv_io_cmd cmd = { queueId, tag, -1, reinterpret_cast<u64>(buffers + static_cast<size_t>(tag) * maxIoSize) };
+            ring->queueCommand(this->charFd, this->ioOpcode(UBLK_IO_FETCH_REQ), &cmd, sizeof(cmd), tag);
+        }
+        ring->submit(0);
+        fetching = depth;
+    }
+    catch (std::runtime_error& ex)
+    {
+        error = ex.what();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!error.empty() && this->queueError.empty())
+        {
+            this->queueError = error;
+        }
+        this->readyQueues++;
+    }
+    this->queueReady.notify_one();
+
+    const ublksrv_io_desc* requests = static_cast<const ublksrv_io_desc*>(descriptors);
+    while (fetching > 0 && error.empty())
+    {
+        try
+        {
+            // Sends commits of the previous batch and waits for new requests
+            ring->submit(1);
+        }
+        catch (std::runtime_error& ex)
+        {
+            error = ex.what();
+            break;
+        }
+
+        io_uring_cqe cqe;
+        while (ring->popCompletion(cqe))
+        {
+            u16 tag = cqe.user_data;
+            if (cqe.res != UBLK_IO_RES_OK)
+            {
+                // Device is stopping, the tag won't get more requests
+                fetching--;
+                continue;
+            }
+
+            const ublksrv_io_desc& request = requests[tag];
+            char* buf = buffers + static_cast<size_t>(tag) * maxIoSize;
+            int result = this->handleRequest(ublksrv_get_op(&request), buf, request.nr_sectors << 9, request.start_sector << 9);
+
+            ublksrv_io_cmd cmd = { queueId, tag, result, reinterpret_cast<u64>(buf) };
+            ring->queueCommand(this->charFd, this->ioOpcode(UBLK_IO_COMMIT_AND_FETCH_REQ), &cmd, sizeof(cmd), tag);
+        }
+    }
+
+    ring.reset();
+    if (descriptors != MAP_FAILED)
+    {
+        munmap(descriptors, descriptorsSize);
+    }
+    free(buffers);
+
+    // Device stopped from outside or queue has failed, main thread has to stop the rest
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!error.empty() && this->queueError.empty())
+    {
+        this->queueError = error;
+    }
+    if (--this->runningQueues == 0 || !error.empty())
+    {
+        pthread_kill(mainThread, SIGTERM);
+    }
+}
+
+int UblkDevice::handleRequest(u8 op, void* buf, u32 len, u64 offset)
+{
+    switch (op)
+    {
+    case UBLK_IO_OP_READ:
+        // Exception escaping queue thread would terminate us with the device still registered
+        try
+        {
+            return this->options.read(buf, len, offset) == 0 ? static_cast<int>(len) : -EIO;
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << "Error occured while reading data: " << ex.what() << std::endl;
+            return -EIO;
+        }
+    case UBLK_IO_OP_FLUSH:
+        return 0;
+    default:
+        // Device is read only
+        return -EROFS;
+    }
+}
+
+} // end namespace sg
@@ -0,0 +1,161 @@
+#include "xor_kernel.hpp"
+#include <immintrin.h>
+#include <string.h>
+
+namespace sg
+{
+
+typedef void (*XorRangeFunction)(char* out, const char* const* sources, u32 count, size_t start, size_t len);
+
+// Every variant XORs bytes from start to len. It handles what it can
+// with its vectors and passes the tail, smaller than one vector, to narrower variant.
+static void xorScalar(char* out, const char* const* sources, u32 count, size_t start, size_t len)
+{
+    for (size_t i = start; i < len; i++)
+    {
+        char acc = out[i];
+        for (u32 s = 0; s < count; s++)
+        {
+            acc ^= sources[s][i];
+        }
+        out[i] = acc;
+    }
+}
+
+__attribute__((target("sse2")))
+static void xorSse2(char* out, const char* const* sources, u32 count, size_t start, size_t len)
+{
+    size_t i = start;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i acc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i));
+        for (u32 s = 0; s < count; s++)
+        {
+            acc = _mm_xor_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(sources[s] + i)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), acc);
+    }
+
+    xorScalar(out, sources, count, i, len);
+}
+
+__attribute__((target("avx2")))
+static void xorAvx2(char* out, const char* const* sources, u32 count, size_t start, size_t len)
+{
+    size_t i = start;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i));
+        for (u32 s = 0; s < count; s++)
+        {
+            acc = _mm256_xor_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[s] + i)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), acc);
+    }
+
+    xorSse2(out, sources, count, i, len);
+}
+
+__attribute__((target("avx512f")))
+static void xorAvx512(char* out, const char* const* sources, u32 count, size_t start, size_t len)
+{
+    size_t i = start;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m512i acc = _mm512_loadu_si512(out + i);
+        for (u32 s = 0; s < count; s++)
+        {
+            acc = _mm512_xor_si512(acc, _mm512_loadu_si512(sources[s] + i));
+        }
+        _mm512_storeu_si512(out + i, acc);
+    }
+
+    xorAvx2(out, sources, count, i, len);
+}
+
+// Runs range variant on whole buffer
+template <XorRangeFunction xorRange>
+static void xorWhole(void* out, const void* const* sources, u32 count, size_t len)
+{
+    xorRange(static_cast<char*>(out), reinterpret_cast<const char* const*>(sources), count, 0, len);
+}
+
+std::vector<XorKernel> xorKernels()
+{
+    __builtin_cpu_init();
+    // Every x86-64 CPU has SSE2
+    std::vector<XorKernel> kernels = { { "scalar", xorWhole<xorScalar> }, { "sse2", xorWhole<xorSse2> } };
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.push_back({ "avx2", xorWhole<xorAvx2> });
+    }
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        kernels.push_back({ "avx512", xorWhole<xorAvx512> });
+    }
+    return kernels;
+}
+
+static const XorKernel xorKernel = xorKernels().back();
+
+void xorInto(void* out, const void* const* sources, u32 count, size_t len)
+{
+    xorKernel.function(out, sources, count, len);
+}
+
+const char* xorKernelName()
+{
+    return xorKernel.name;
+}
+
+bool isZero(const void* buf, size_t len)
+{
+    // Compared with itself shifted by one byte, memcmp is vectorized well enough
+    const char* bytes = static_cast<const char*>(buf);
+    return len == 0 || (bytes[0] == 0 && memcmp(bytes, bytes + 1, len - 1) == 0);
+}
+
+XorAccumulator::XorAccumulator(void* out, size_t len)
+    : out(out), len(len)
+{
+}
+
+void XorAccumulator::outputRead()
+{
+    this->outputReady = true;
+    if (this->count == XOR_FOLD_SOURCES)
+    {
+        this->fold();
+    }
+}
+
+void XorAccumulator::add(void* source)
+{
+    this->sources[this->count++] = source;
+    if (this->count == XOR_FOLD_SOURCES)
+    {
+        this->fold();
+    }
+}
+
+void XorAccumulator::finish()
+{
+    xorInto(this->out, this->sources, this->count, this->len);
+    this->count = 0;
+}
+
+void XorAccumulator::fold()
+{
+    if (this->outputReady)
+    {
+        xorInto(this->out, this->sources, this->count, this->len);
+        this->count = 0;
+    }
+    else
+    {
+        xorInto(this->sources[0], this->sources + 1, this->count - 1, this->len);
+        this->count = 1;
+    }
+}
+
+} // end namespace sg
@@ -0,0 +1,77 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include "xor_kernel.hpp"
+#include "types.hpp"
+
+using namespace sg;
+
+// Microbenchmark of XOR variants used by parity recovery.
+// Usage: xor-bench [buffer size in KiB, default 256] [sources per pass, default 4]
+
+static const double SECONDS_PER_VARIANT = 0.5;
+
+int main(int argc, char** argv)
+{
+    size_t len = (argc > 1 ? std::stoul(argv[1]) : 256) * 1024;
+    u32 count = argc > 2 ? std::stoul(argv[2]) : XOR_FOLD_SOURCES;
+
+    if (len == 0 || count == 0)
+    {
+        std::cerr << "Usage: " << argv[0] << " [buffer size in KiB] [sources per pass]" << std::endl;
+        return -1;
+    }
+
+    std::mt19937_64 random(1);
+    std::vector<std::vector<char>> sources(count, std::vector<char>(len));
+    std::vector<const void*> sourcePointers;
+    for (auto& source : sources)
+    {
+        for (auto& byte : source)
+        {
+            byte = random();
+        }
+        sourcePointers.push_back(source.data());
+    }
+
+    std::vector<char> expected(len, 0);
+    std::vector<char> out(len);
+    auto kernels = xorKernels();
+    kernels.front().function(expected.data(), sourcePointers.data(), count, len);
+
+    std::cout << "XOR of " << count << " sources into " << len / 1024 << " KiB buffer, "
+              << "GB/s counts bytes read from sources." << std::endl;
+
+    for (auto& kernel : kernels)
+    {
+        // Correctness first, every variant has to match the scalar one
+        std::fill(out.begin(), out.end(), 0);
+        kernel.function(out.data(), sourcePointers.data(), count, len);
+        bool correct = memcmp(out.data(), expected.data(), len) == 0;
+
+        u64 passes = 0;
+        auto start = std::chrono::steady_clock::now();
+        double seconds;
+        do
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                kernel.function(out.data(), sourcePointers.data(), count, len);
+            }
+            passes += 16;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < SECONDS_PER_VARIANT);
+
+        double gigabytes = static_cast<double>(passes) * count * len / 1e9;
+        std::cout << std::left << std::setw(8) << kernel.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(8) << gigabytes / seconds << " GB/s"
+                  << (correct ? "" : "  WRONG RESULT")
+                  << (strcmp(kernel.name, xorKernelName()) == 0 ? "  (used)" : "") << std::endl;
+    }
+
+    return 0;
+}